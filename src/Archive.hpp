@@ -0,0 +1,176 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  Archive.hpp
+ *  @brief Compressed (.tar.gz) archives of the files generated while grading a submission.
+ *
+ *  Archives are standard ustar files streamed through gzip, so they can also be opened with
+ *  "tar -xzf".  Files are written in chunks as they are read, so memory use stays small.
+ */
+
+#ifndef EMPERFECT_ARCHIVE_HPP
+#define EMPERFECT_ARCHIVE_HPP
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "Process.hpp"
+
+// Information about one file stored in an archive.
+struct ArchiveEntry {
+  std::string name;    // Path of the file inside the archive.
+  size_t size = 0;     // Size in bytes.
+  long long mtime = 0; // Last modification time (unix time).
+};
+
+class Archive {
+private:
+  static constexpr size_t BLOCK_SIZE = 512;
+
+  // Choose a safe name for a file inside the archive (no absolute paths or "..").
+  static std::string ArchiveName(const std::string & filename) {
+    std::filesystem::path out;
+    for (const auto & part : std::filesystem::path(filename).lexically_normal().relative_path()) {
+      if (part != "..") out /= part;
+    }
+    return out.string();
+  }
+
+  static void WriteOctal(char * field, size_t width, unsigned long long value) {
+    std::snprintf(field, width, "%0*llo", static_cast<int>(width - 1), value);
+  }
+
+  // Build the ustar header for a file; return false if the name is too long to store.
+  static bool MakeHeader(const ArchiveEntry & entry, char * header) {
+    std::memset(header, 0, BLOCK_SIZE);
+    std::string name = entry.name, prefix;
+    if (name.size() > 100) {  // Long names are split into a prefix and a name at a '/'.
+      const size_t split_pos = name.rfind('/', 155);
+      if (split_pos == std::string::npos || name.size() - split_pos - 1 > 100) return false;
+      prefix = name.substr(0, split_pos);
+      name = name.substr(split_pos + 1);
+    }
+    std::memcpy(header, name.data(), name.size());
+    WriteOctal(header + 100, 8, 0644);                   // mode
+    WriteOctal(header + 108, 8, 0);                      // uid
+    WriteOctal(header + 116, 8, 0);                      // gid
+    WriteOctal(header + 124, 12, entry.size);            // size
+    WriteOctal(header + 136, 12, static_cast<unsigned long long>(entry.mtime));
+    header[156] = '0';                                   // Regular file.
+    std::memcpy(header + 257, "ustar", 6);
+    std::memcpy(header + 263, "00", 2);
+    std::memcpy(header + 345, prefix.data(), prefix.size());
+
+    // The checksum is computed with its own field set to spaces.
+    std::memset(header + 148, ' ', 8);
+    unsigned int checksum = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) checksum += static_cast<unsigned char>(header[i]);
+    std::snprintf(header + 148, 8, "%06o", checksum);
+    header[155] = ' ';
+    return true;
+  }
+
+  static std::string ReadString(const char * field, size_t width) {
+    return std::string(field, strnlen(field, width));
+  }
+
+public:
+  // Stream files into a new compressed archive.  Returns false if the archive could not be written.
+  static bool Write(const std::string & archive_filename, const std::vector<std::string> & files,
+                    const std::string & compress="gzip -c") {
+    Process process(compress + " > '" + archive_filename + "'");
+    process.UseShell().PipeInput();
+    if (!process.Start()) return false;
+    const auto deadline = Process::time_point_t::max();
+
+    bool success = true;
+    std::vector<char> chunk(64 * BLOCK_SIZE);
+    for (const auto & filename : files) {
+      std::ifstream file(filename, std::ios::binary);
+      if (!file) continue;  // Skip files that have gone missing.
+      ArchiveEntry entry;
+      entry.name = ArchiveName(filename);
+      struct stat info;
+      if (stat(filename.c_str(), &info) != 0) continue;
+      entry.size = static_cast<size_t>(info.st_size);
+      entry.mtime = static_cast<long long>(info.st_mtime);
+
+      char header[BLOCK_SIZE];
+      if (!MakeHeader(entry, header)) { success = false; continue; }
+      success &= process.Write(std::string(header, BLOCK_SIZE), deadline);
+
+      // Copy the contents, padded out to a full block.
+      size_t remaining = entry.size;
+      while (remaining > 0 && success) {
+        const size_t count = std::min(remaining, chunk.size());
+        std::fill(chunk.begin(), chunk.end(), '\0');
+        file.read(chunk.data(), static_cast<std::streamsize>(count));
+        const size_t padded = (count + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+        success &= process.Write(std::string(chunk.data(), padded), deadline);
+        remaining -= count;
+      }
+    }
+    success &= process.Write(std::string(2 * BLOCK_SIZE, '\0'), deadline);  // End of archive.
+    process.CloseInput();
+    process.Wait(deadline);
+    return success && process.GetExitCode() == 0;
+  }
+
+  // Read through a compressed archive, calling fun with each entry and its contents.
+  static bool Read(const std::string & archive_filename,
+                   std::function<void(const ArchiveEntry &, const std::string &)> fun) {
+    Process process("gzip -dc '" + archive_filename + "'");
+    process.UseShell().PipeOutput();
+    if (!process.Start()) return false;
+    const auto deadline = Process::time_point_t::max();
+
+    while (true) {
+      const std::string header = process.Read(BLOCK_SIZE, deadline);
+      if (header.size() < BLOCK_SIZE || header[0] == '\0') break;  // End of archive.
+
+      ArchiveEntry entry;
+      entry.name = ReadString(header.data(), 100);
+      const std::string prefix = ReadString(header.data() + 345, 155);
+      if (prefix.size()) entry.name = prefix + "/" + entry.name;
+      entry.size = std::strtoull(ReadString(header.data() + 124, 12).c_str(), nullptr, 8);
+      entry.mtime = std::strtoll(ReadString(header.data() + 136, 12).c_str(), nullptr, 8);
+
+      const size_t padded = (entry.size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+      std::string contents = process.Read(padded, deadline);
+      if (contents.size() < padded) return false;  // Archive was cut short.
+      contents.resize(entry.size);
+      fun(entry, contents);
+    }
+    process.Wait(deadline);
+    return process.GetExitCode() == 0;
+  }
+
+  // Extract files from an archive into a directory (all files if names is empty).
+  static bool Extract(const std::string & archive_filename, const std::vector<std::string> & names,
+                      const std::string & dir=".") {
+    bool success = true;
+    const bool read_ok = Read(archive_filename, [&](const ArchiveEntry & entry, const std::string & contents) {
+      if (names.size() && std::find(names.begin(), names.end(), entry.name) == names.end()) return;
+      const std::filesystem::path path = std::filesystem::path(dir) / ArchiveName(entry.name);
+      std::error_code error;
+      std::filesystem::create_directories(path.parent_path(), error);
+      std::ofstream file(path, std::ios::binary);
+      file << contents;
+      success &= static_cast<bool>(file);
+    });
+    return read_ok && success;
+  }
+};
+
+#endif
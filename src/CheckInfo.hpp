@@ -16,6 +16,9 @@
 #include "emp/datastructs/vector_utils.hpp"
 #include "emp/tools/String.hpp"
 
+#include "extras.hpp"
+#include "PerfMetric.hpp"
+
 using string_block_t = emp::vector<emp::String>;
 
 // Parsed information about a given check.
@@ -61,6 +64,22 @@ public:
     comparator = "TYPE";
   }
 
+  // Check if a compiler optimization (e.g., "vectorized") was applied to a function.
+  void SetCheckOptimization(const emp::String & function, const emp::String & optimization) {
+    test.Set(emp::to_upper(optimization), "(", function, ")");
+    lhs = function;
+    rhs = optimization;
+    comparator = "IS";
+  }
+
+  // Check a property of the machine code generated for a function (e.g., "no_calls").
+  void SetCheckCodegen(const emp::String & function, const emp::String & property) {
+    test.Set("CODEGEN(", function, ", ", property, ")");
+    lhs = function;
+    rhs = property;
+    comparator = "HAS";
+  }
+
   const emp::String & ToString() const { return test; }
   emp::String ToLiteral() const { return test.AsLiteral(); }
   emp::String GetLHS() const { return lhs; }
@@ -72,7 +91,27 @@ public:
 enum class CheckType {
   UNKNOWN = 0,
   ASSERT,
-  TYPE_COMPARE
+  TYPE_COMPARE,
+  CONSTEXPR,
+  VECTORIZED,   // Checked at compile time from the optimization report.
+  INLINED,      // Checked at compile time from the optimization report.
+  CODEGEN       // Checked after compilation by disassembling the executable.
+};
+
+// Result of trying to evaluate a check's expression at compile time.
+struct ConstexprResult {
+  bool success = false;       // Could the expression be evaluated at compile time?
+  double seconds = 0.0;       // How long did evaluation (or the whole probe compile) take?
+  bool from_report = false;   // Did the time come from the compiler's time report?
+  emp::String error;          // First error message from the compiler, if any.
+};
+
+// Time spent evaluating a check, across every time it was run.
+struct CheckTiming {
+  size_t count = 0;     // How many times was this check run?
+  double total = 0.0;   // Total seconds spent in the check.
+  double min = 0.0;     // Seconds for the fastest run.
+  double max = 0.0;     // Seconds for the slowest run.
 };
 
 class CheckInfo {
@@ -88,6 +127,8 @@ private:
   emp::vector<emp::String> rhs_value;  // Resulting value on right (e.g., "21", if rhs is "x+5" and x=16)
   emp::BitVector passed = false;       // Was this check successful?
   emp::vector<emp::String> error_out;  // Message from test runner for students.
+  ConstexprResult constexpr_result;    // For CONSTEXPR checks, results of compile-time evaluation.
+  CheckTiming timing;                  // How long did this check take to evaluate?
 
 public:
   CheckInfo(const emp::String & check_body, emp::String _location, size_t _id, CheckType _type)
@@ -97,7 +138,7 @@ public:
 
     error_msgs = check_body.Slice(",", emp::StringSyntax{"\"","(){}"}, true);
 
-    if (type == CheckType::ASSERT) {
+    if (type == CheckType::ASSERT || type == CheckType::CONSTEXPR) {
       // Split off the test (the first argument) and make sure it's valid.
       emp::notify::TestError(error_msgs.size() == 0, location, ": CHECK cannot be empty.");
       test.SetCheck(emp::PopFront(error_msgs), location);
@@ -109,23 +150,88 @@ public:
       emp::String rhs = emp::PopFront(error_msgs);
       test.SetCheckType(lhs, rhs, location);
     }
+    else if (type == CheckType::VECTORIZED || type == CheckType::INLINED) {
+      // The first argument is the name of the function to examine.
+      emp::notify::TestError(error_msgs.size() == 0, location, ": Optimization checks need a function name.");
+      emp::String function = emp::PopFront(error_msgs);
+      function.Trim();
+      test.SetCheckOptimization(function, type == CheckType::VECTORIZED ? "vectorized" : "inlined");
+    }
+    else if (type == CheckType::CODEGEN) {
+      // The first argument is the function to examine, the second is the property it must have.
+      emp::notify::TestError(error_msgs.size() < 2, location,
+        ": CHECK_CODEGEN needs a function name and a property.");
+      emp::String function = emp::PopFront(error_msgs);
+      emp::String property = emp::PopFront(error_msgs);
+      function.Trim();
+      property.Trim();
+      emp::notify::TestError(property != "no_calls" && property != "no_alloc" &&
+                             GetMaxInstructions(property) == 0, location,
+        ": Unknown CHECK_CODEGEN property '", property,
+        "'; options are max_instructions=N, no_calls, and no_alloc.");
+      test.SetCheckCodegen(function, property);
+    }
 
   }
   CheckInfo(const CheckInfo &) = default;
 
   size_t GetID() const { return id; }
+  CheckType GetType() const { return type; }
+  bool IsCompileTime() const {
+    return type == CheckType::VECTORIZED || type == CheckType::INLINED || type == CheckType::CODEGEN;
+  }
+  const CheckString & GetTest() const { return test; }
   bool Passed() const { return passed.size() && passed.All(); }
   bool PassedAny() const { return passed.Any(); }
 
   void PushResult(bool success) { passed.push_back(success); }
+  void ClearResults() {
+    lhs_value.resize(0);
+    rhs_value.resize(0);
+    passed.Resize(0);
+    error_out.resize(0);
+    timing = CheckTiming();
+  }
   void PushLHSValue(emp::String _in) { _in.Trim(); lhs_value.push_back(_in); }
   void PushRHSValue(emp::String _in) { _in.Trim(); rhs_value.push_back(_in); }
   void PushErrorMsg(emp::String _in) { _in.Trim(); error_out.push_back(_in); }
+  void SetConstexprResult(const ConstexprResult & _in) { constexpr_result = _in; }
+  void SetTiming(const CheckTiming & _in) { timing = _in; }
+  const CheckTiming & GetTiming() const { return timing; }
+  bool HasTiming() const { return timing.count > 0; }
+
+  // Describe the time spent on this check, e.g. "3 runs, 1.20 ms total (min 0.30 ms, max 0.50 ms)"
+  emp::String GetTimingString() const {
+    const std::string total = PerfMetric::FormatValue(timing.total, PerfUnit::SECONDS);
+    if (timing.count == 1) return emp::MakeString("1 run, ", total);
+    return emp::MakeString(timing.count, " runs, ", total, " total (min ",
+                           PerfMetric::FormatValue(timing.min, PerfUnit::SECONDS), ", max ",
+                           PerfMetric::FormatValue(timing.max, PerfUnit::SECONDS), ")");
+  }
+
+  // Find the limit in a "max_instructions=N" property (or 0 if it is not one).
+  static size_t GetMaxInstructions(const emp::String & property) {
+    const emp::String prefix = "max_instructions=";
+    if (property.substr(0, prefix.size()) != prefix) return 0;
+    const emp::String limit(property.substr(prefix.size()));
+    if (!limit.size() || !limit.IsNumber()) return 0;
+    return limit.As<size_t>();
+  }
+
+  // Error messages provided as string literals (for checks that are evaluated outside of C++).
+  emp::String GetStaticErrorMsg() const {
+    emp::String out;
+    for (const emp::String & msg : error_msgs) {
+      if (msg.size() && msg[0] == '"') out += emp::from_literal_string(msg);
+    }
+    return out;
+  }
 
   void ToCPP_CHECK(std::ostream & out) const {
     // Generate code for this test.
     out << "  // CHECK #" << id << "\n"
         << "  {\n"
+        << "    const auto _emperfect_start = _emperfect_check_begin(" << id << ");\n"
         << "    auto _emperfect_lhs = " << test.GetLHS() << ";\n";
     if (test.HasComp()) {
       emp::String rhs_string = test.GetRHS();
@@ -146,6 +252,7 @@ public:
     // Generate code for this test.
     out << "  // CHECK #" << id << " (CHECK_TYPE)\n"
         << "  {\n"
+        << "    const auto _emperfect_start = _emperfect_check_begin(" << id << ");\n"
         << "    using _emperfect_type1 = decltype(" << test.GetLHS() << ");\n"
         << "    using _emperfect_type2 = " << test.GetRHS() << ";\n"
         << "    std::string _emperfect_lhs = _EMP_GetTypeName<_emperfect_type1>();\n"
@@ -153,19 +260,54 @@ public:
         << "    bool _emperfect_success = std::is_same<_emperfect_type1, _emperfect_type2>();\n";
   }
 
+  void ToCPP_CHECK_CONSTEXPR(std::ostream & out) const {
+    // Generate code for this test.
+    out << "  // CHECK #" << id << " (CHECK_CONSTEXPR)\n"
+        << "  {\n"
+        << "    const auto _emperfect_start = _emperfect_check_begin(" << id << ");\n";
+
+    // If the compiler could not evaluate the expression, don't put it in the test at all.
+    if (!constexpr_result.success) {
+      out << "    std::string _emperfect_lhs = \"(not a constant expression)\";\n"
+          << "    std::string _emperfect_rhs = \"N/A\";\n"
+          << "    bool _emperfect_success = false;\n";
+      return;
+    }
+
+    out << "    constexpr auto _emperfect_lhs = " << test.GetLHS() << ";\n";
+    if (test.HasComp()) {
+      out << "    auto _emperfect_rhs = " << test.GetRHS() << ";\n"
+          << "    bool _emperfect_success = (_emperfect_lhs " << test.GetComparator() << " _emperfect_rhs);\n";
+    } else {
+      out << "    auto _emperfect_rhs = \"N/A\";\n"
+          << "    bool _emperfect_success = _emperfect_lhs;\n";
+    }
+  }
+
   emp::String ToCPP() const {
     std::stringstream out;
 
+    // Checks on compiler output are evaluated by Emperfect, not in the generated code.
+    if (IsCompileTime()) {
+      out << "  // CHECK #" << id << " (" << test.ToString() << ") is checked during compilation.\n";
+      return out.str();
+    }
+
     // Generate the test
     if (type == CheckType::ASSERT) ToCPP_CHECK(out);
     else if (type == CheckType::TYPE_COMPARE) ToCPP_CHECK_TYPE(out);
+    else if (type == CheckType::CONSTEXPR) ToCPP_CHECK_CONSTEXPR(out);
 
-    // Save the results.
-    out << "    std::string _emperfect_msg = \"Success!\";\n"
+    // Record how long the check took (and update the heartbeat), then save the results.
+    out << "    _emperfect_check_end(" << id << ", _emperfect_success, _emperfect_start);\n"
+        << "    std::string _emperfect_msg = \"Success!\";\n"
         << "    if (!_emperfect_success) {\n"
         << "      _emperfect_error_count++;\n"
         << "      std::stringstream ss;\n"
         << "      ss << \"[ERROR] \";\n";
+    if (type == CheckType::CONSTEXPR && !constexpr_result.success) {
+      out << "      ss << \"Expression cannot be evaluated at compile time. \";\n";
+    }
     for (emp::String x : error_msgs) {
       out << "      ss << " << x << ";\n";
     }
@@ -191,6 +333,54 @@ public:
     }
   }
 
+  // Describe how compile-time evaluation went for CONSTEXPR checks.
+  emp::String GetConstexprString() const {
+    if (!constexpr_result.success) {
+      if (constexpr_result.error.empty()) return "Failed to evaluate at compile time.";
+      return emp::MakeString("Failed to evaluate at compile time. Compiler: ", constexpr_result.error);
+    }
+    if (constexpr_result.from_report) {
+      return emp::MakeString(constexpr_result.seconds, " s of constant expression evaluation");
+    }
+    return emp::MakeString(constexpr_result.seconds, " s to compile (no compiler time report found)");
+  }
+
+  // Values longer than this are shown as a window around their first difference.
+  static constexpr size_t LONG_VALUE_SIZE = 200;
+
+  // Should the values of a comparison be shown only around where they differ?
+  bool UseDiffWindow(size_t call_id) const {
+    return !passed[call_id] && lhs_value[call_id] != rhs_value[call_id] &&
+      std::max(lhs_value[call_id].size(), rhs_value[call_id].size()) > LONG_VALUE_SIZE;
+  }
+
+  // Show one side of a diff window, with the differing text highlighted.
+  static emp::String FormatExcerpt(const DiffExcerpt & excerpt, bool html) {
+    auto skipped = [html](size_t count) -> emp::String {
+      if (count == 0) return "";
+      emp::String note = emp::MakeString("[...", count, " chars...]");
+      return html ? emp::MakeString("<i>", note, "</i>") : note;
+    };
+    if (html) {
+      return emp::MakeString(skipped(excerpt.skipped_before), emp::String(excerpt.before).AsWebSafe(),
+        "<span style=\"background-color:yellow\">", emp::String(excerpt.diff).AsWebSafe(),
+        skipped(excerpt.skipped_diff), "</span>", emp::String(excerpt.after).AsWebSafe(),
+        skipped(excerpt.skipped_after));
+    }
+    return emp::MakeString(skipped(excerpt.skipped_before), excerpt.before, ">>", excerpt.diff,
+      skipped(excerpt.skipped_diff), "<<", excerpt.after, skipped(excerpt.skipped_after));
+  }
+
+  // Describe where two long values first differ.
+  emp::String GetDiffNote(size_t call_id) const {
+    const auto & lhs = lhs_value[call_id];
+    const auto & rhs = rhs_value[call_id];
+    size_t pos = 0;
+    while (pos < lhs.size() && pos < rhs.size() && lhs[pos] == rhs[pos]) ++pos;
+    return emp::MakeString("Values have ", lhs.size(), " and ", rhs.size(),
+                           " characters and first differ at character ", pos, "; showing only that area.");
+  }
+
   void PrintResults(OutputInfo & output, size_t call_id) const {
     std::ostream & out = output.GetFile();
 
@@ -207,9 +397,24 @@ public:
       if (error_out[call_id].size()) {
         out << "Error Message: " << error_out[call_id].AsWebSafe() << "<br>\n";
       }
+      if (type == CheckType::CONSTEXPR) {
+        out << "Compile-time evaluation: " << GetConstexprString().AsWebSafe() << "<br>\n";
+      }
+      if (HasTiming()) out << "Time: " << GetTimingString().AsWebSafe() << "<br>\n";
 
       // If there was a comparison, show results on both sides of it.
-      if (test.HasComp()) {
+      if (test.HasComp() && UseDiffWindow(call_id)) {
+        const auto [lhs_excerpt, rhs_excerpt] = DiffWindow(static_cast<std::string>(lhs_value[call_id]),
+                                                          static_cast<std::string>(rhs_value[call_id]));
+        out << GetDiffNote(call_id).AsWebSafe() << "<br>\n"
+            << "<table><tr><td>Left side:<td><code>" << test.GetLHS().AsWebSafe()
+            << "</code><td>&nbsp;&nbsp;==><td><code>" << FormatExcerpt(lhs_excerpt, true)
+            << "</code></tr>\n"
+            << "<tr><td>Right side:<td><code>" << test.GetRHS().AsWebSafe()
+            << "</code><td>&nbsp;&nbsp;==><td><code>"
+            << FormatExcerpt(rhs_excerpt, true) << "</code></tr></table><br>\n";
+      }
+      else if (test.HasComp()) {
         out << "<table><tr><td>Left side:<td><code>" << test.GetLHS().AsWebSafe()
             << "</code><td>&nbsp;&nbsp;==><td><code>" << lhs_value[call_id].AsWebSafe()
             << "</code></tr>\n"
@@ -224,14 +429,27 @@ public:
       if (error_out[call_id].size()) {
         out << "Error Message: " << error_out[call_id] << "\n";
       }
+      if (type == CheckType::CONSTEXPR) {
+        out << "Compile-time evaluation: " << GetConstexprString() << "\n";
+      }
+      if (HasTiming()) out << "Time: " << GetTimingString() << "\n";
 
       // If there was a comparison, show results on both sides of it.
       if (test.HasComp()) {
         size_t max_width = std::max(test.GetLHS().size(), test.GetRHS().size());
+        emp::String lhs_shown = lhs_value[call_id];
+        emp::String rhs_shown = rhs_value[call_id];
+        if (UseDiffWindow(call_id)) {
+          const auto [lhs_excerpt, rhs_excerpt] = DiffWindow(static_cast<std::string>(lhs_value[call_id]),
+                                                          static_cast<std::string>(rhs_value[call_id]));
+          lhs_shown = FormatExcerpt(lhs_excerpt, false);
+          rhs_shown = FormatExcerpt(rhs_excerpt, false);
+          out << GetDiffNote(call_id) << "\n";
+        }
         out << "Left side : " << test.GetLHS().PadBack(' ', max_width)
-                              << "  ==>  " << lhs_value[call_id] << "\n"
+                              << "  ==>  " << lhs_shown << "\n"
             << "Right side: " << test.GetRHS().PadBack(' ', max_width)
-                              << "  ==>  " << rhs_value[call_id] << "\n";
+                              << "  ==>  " << rhs_shown << "\n";
       }
 
     }
@@ -0,0 +1,137 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  Disassembly.hpp
+ *  @brief Machine code for the functions in an executable, as listed by "objdump -d -C".
+ *
+ *  Each function starts with a line like "0000000000001139 <Sum(int, int)>:" and is followed by
+ *  one line per instruction, such as "    1139:\tlea    (%rdi,%rsi,1),%eax".
+ */
+
+#ifndef EMPERFECT_DISASSEMBLY_HPP
+#define EMPERFECT_DISASSEMBLY_HPP
+
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Machine code for a single function.
+struct FunctionCode {
+  std::string symbol;                     // Full (demangled) symbol, e.g. "Sum(int, int)"
+  std::vector<std::string> instructions;  // Instructions, e.g. "call   1030 <malloc@plt>"
+
+  // Is an instruction a function call (including tail-calls through a jump to another symbol)?
+  static bool IsCall(const std::string & inst) {
+    if (inst.starts_with("call") || inst.starts_with("bl ") || inst.starts_with("blr")) return true;
+    // A jump to the start of a function (e.g., "jmp 1030 <free@plt>") is a tail-call; jumps
+    // within a function have an offset (e.g., "jmp 1150 <Sum(int, int)+0x10>").
+    if (!inst.starts_with("jmp")) return false;
+    const size_t target_pos = inst.find('<');
+    return target_pos != std::string::npos && inst.find("+0x", target_pos) == std::string::npos;
+  }
+
+  // Does an instruction call a memory allocation function?
+  static bool IsAlloc(const std::string & inst) {
+    if (!IsCall(inst) && !inst.starts_with("jmp")) return false;
+    for (const char * name : {"<operator new", "<malloc", "<calloc", "<realloc",
+                              "<aligned_alloc", "<posix_memalign"}) {
+      if (inst.find(name) != std::string::npos) return true;
+    }
+    return false;
+  }
+
+  // Remove alignment padding that follows the last instruction.
+  void TrimPadding() {
+    while (instructions.size() && (instructions.back().starts_with("nop") ||
+                                   instructions.back().starts_with("cs nop") ||
+                                   instructions.back().starts_with("data16") ||
+                                   instructions.back().starts_with("xchg   %ax,%ax") ||
+                                   instructions.back().starts_with("int3"))) {
+      instructions.pop_back();
+    }
+  }
+
+  // Collect all instructions that match a test.
+  std::vector<std::string> Collect(bool (*test)(const std::string &)) const {
+    std::vector<std::string> out;
+    for (const auto & inst : instructions) if (test(inst)) out.push_back(inst);
+    return out;
+  }
+};
+
+class Disassembly {
+private:
+  std::vector<FunctionCode> functions;
+
+  // Find the unqualified name of a function from its symbol, e.g. "int ns::Sum<int>(int, int)"
+  // becomes "Sum".
+  static std::string BaseName(const std::string & symbol) {
+    // Find the opening paren of the parameter list (skipping anything inside of template args).
+    size_t end = 0;
+    int depth = 0;
+    while (end < symbol.size() && !(symbol[end] == '(' && depth == 0)) {
+      if (symbol[end] == '<') ++depth;
+      else if (symbol[end] == '>') --depth;
+      ++end;
+    }
+    // Back up over any template arguments on the function itself.
+    if (end > 0 && symbol[end-1] == '>') {
+      depth = 0;
+      while (end > 0) {
+        --end;
+        if (symbol[end] == '>') ++depth;
+        else if (symbol[end] == '<' && --depth == 0) break;
+      }
+    }
+    size_t start = end;
+    while (start > 0 && (std::isalnum(static_cast<unsigned char>(symbol[start-1])) ||
+                         symbol[start-1] == '_' || symbol[start-1] == '~')) --start;
+    return symbol.substr(start, end - start);
+  }
+
+public:
+  // Load a disassembly listing.
+  void Load(const std::string & filename) {
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+      // Function header: "<address> <symbol>:"
+      const size_t open_pos = line.find(" <");
+      if (line.size() && std::isxdigit(static_cast<unsigned char>(line[0])) &&
+          open_pos != std::string::npos && line.ends_with(">:")) {
+        if (functions.size()) functions.back().TrimPadding();
+        functions.push_back(FunctionCode{ line.substr(open_pos+2, line.size()-open_pos-4), {} });
+        continue;
+      }
+
+      // Instruction: "<address>:\t<instruction>"
+      const size_t tab_pos = line.find(":\t");
+      if (functions.empty() || tab_pos == std::string::npos) continue;
+      std::string inst = line.substr(tab_pos+2);
+      const size_t last_tab = inst.rfind('\t');          // Skip raw bytes, if listed.
+      if (last_tab != std::string::npos) inst = inst.substr(last_tab+1);
+      while (inst.size() && std::isspace(static_cast<unsigned char>(inst.back()))) inst.pop_back();
+      if (inst.empty() || inst == "(bad)") continue;
+      functions.back().instructions.push_back(inst);
+    }
+    if (functions.size()) functions.back().TrimPadding();
+  }
+
+  size_t GetNumFunctions() const { return functions.size(); }
+
+  // Find all functions (e.g., all overloads) with the given name.
+  std::vector<const FunctionCode *> Find(std::string name) const {
+    const size_t colon_pos = name.rfind("::");
+    if (colon_pos != std::string::npos) name = name.substr(colon_pos+2);
+    std::vector<const FunctionCode *> out;
+    for (const auto & function : functions) {
+      if (BaseName(function.symbol) == name) out.push_back(&function);
+    }
+    return out;
+  }
+};
+
+#endif
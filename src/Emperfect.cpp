@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "emp/config/command_line.hpp"
 
@@ -8,12 +13,68 @@ int main(int argc, char *argv[])
 {
   std::cout << "Welcome to Emperfect!" << std::endl;
 
+  // Bundle fixture files into a single pack that testcases can refer to as "pack:<file>".
+  if (argc >= 3 && std::string(argv[1]) == "--pack") {
+    std::vector<std::string> files(argv + 3, argv + argc);
+    if (!FixturePack::Create(argv[2], files)) {
+      std::cout << "Error: unable to create fixture pack '" << argv[2] << "'." << std::endl;
+      exit(1);
+    }
+    std::cout << "Packed " << files.size() << " fixtures into '" << argv[2] << "'." << std::endl;
+    return 0;
+  }
+
+  // List, view, or extract the files in a compressed artifact archive.
+  if (argc >= 3 && std::string(argv[1]) == "--archive-list") {
+    const bool success = Archive::Read(argv[2], [](const ArchiveEntry & entry, const std::string &) {
+      std::cout << entry.size << "\t" << entry.name << "\n";
+    });
+    return success ? 0 : 1;
+  }
+  if (argc >= 4 && std::string(argv[1]) == "--archive-view") {
+    const std::vector<std::string> names(argv + 3, argv + argc);
+    const bool success = Archive::Read(argv[2], [&names](const ArchiveEntry & entry, const std::string & contents) {
+      if (std::find(names.begin(), names.end(), entry.name) != names.end()) std::cout << contents;
+    });
+    return success ? 0 : 1;
+  }
+  if (argc >= 3 && std::string(argv[1]) == "--archive-extract") {
+    const std::vector<std::string> names(argv + 3, argv + argc);
+    if (!Archive::Extract(argv[2], names)) {
+      std::cout << "Error: unable to extract from archive '" << argv[2] << "'." << std::endl;
+      exit(1);
+    }
+    return 0;
+  }
+
+  // Rebuild the expected output files for a configuration by running a reference solution.
+  // (With --no-cache, every testcase is rerun rather than reusing cached outputs.)
+  if (argc >= 4 && std::string(argv[1]) == "--refresh-expected") {
+    const bool use_cache = std::string(argv[2]) != "--no-cache";
+    const int arg_id = use_cache ? 2 : 3;
+    if (argc >= arg_id + 2) {
+      const size_t num_jobs = (argc >= arg_id + 3) ? std::strtoul(argv[arg_id + 2], nullptr, 10)
+                                                   : std::max(std::thread::hardware_concurrency(), 1u);
+      Emperfect control;
+      control.SetRefreshExpected(argv[arg_id + 1], num_jobs, use_cache);
+      control.Load(argv[arg_id]);
+      return 0;
+    }
+  }
+
   if (argc != 2) {
     std::cout << "Format: " << argv[0] << " [config filename]" << std::endl;
+    std::cout << "    or: " << argv[0] << " --pack [pack filename] [fixture files...]" << std::endl;
+    std::cout << "    or: " << argv[0] << " --refresh-expected [--no-cache] [config filename] [reference command] [jobs]" << std::endl;
+    std::cout << "    or: " << argv[0] << " --archive-list [archive filename]" << std::endl;
+    std::cout << "    or: " << argv[0] << " --archive-view [archive filename] [files...]" << std::endl;
+    std::cout << "    or: " << argv[0] << " --archive-extract [archive filename] [files... (default: all)]" << std::endl;
     exit(1);
   }
 
   Emperfect control;
   control.Load(argv[1]);
   // control.PrintDebug();
+
+  if (control.WasCancelled()) return 3;  // A newer submission of the same job took over.
 }
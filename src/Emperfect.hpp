@@ -24,7 +24,6 @@
  *  @todo Refactor most of test-case running into Testcase.hpp
  *  @todo Allow a special symbol in the output to exclude from comparisons?  E.g., lines starting with %.
  *  @todo If multi-line compile, make output append for every line past the first.
- *  @todo Collect times for how long test cases actually took.
  *  @todo Add a "contact your instructors" error message for things that shouldn't break.
  *  @todo Web interface for building a config file.
  *  @todo Allow a testcase to provide more dynamic feedback based on student errors.
@@ -34,17 +33,42 @@
 #ifndef EMPERFECT_EMPERFECT_HPP
 #define EMPERFECT_EMPERFECT_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <csignal>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
 
 #include "emp/base/notify.hpp"
 #include "emp/base/vector.hpp"
 #include "emp/datastructs/map_utils.hpp"
 #include "emp/io/File.hpp"
 
+#include "Archive.hpp"
+#include "Disassembly.hpp"
+#include "extras.hpp"
+#include "Fixture.hpp"
+#include "FixturePack.hpp"
+#include "History.hpp"
+#include "Job.hpp"
+#include "Leaderboard.hpp"
+#include "Measurement.hpp"
+#include "Metrics.hpp"
+#include "OptReport.hpp"
+#include "OutputCompare.hpp"
 #include "OutputInfo.hpp"
+#include "PerfMetric.hpp"
+#include "Process.hpp"
 #include "Testcase.hpp"
 
 // Set -DEMPERFECT_COMMENT on the command line to change internal comment marker (removed for students).
@@ -62,6 +86,27 @@ private:
   emp::vector<OutputInfo> outputs;
   emp::vector<emp::String> compile;
   emp::vector<emp::String> header;
+  emp::vector<size_t> noisy_tests;  // Performance tests to re-measure once others are done.
+  emp::vector<size_t> near_timeout_tests;  // Tests to rerun (once others are done) for being close to timing out.
+
+  // A hidden testcase that will be run after visible results are published.
+  struct DeferredTest {
+    size_t test_id;
+    std::map<emp::String, emp::String> vars;  // Variables when the testcase was read.
+    emp::vector<emp::String> header;          // Header when the testcase was read.
+    emp::vector<emp::String> compile;         // Compile rules when the testcase was read.
+  };
+  emp::vector<DeferredTest> deferred_tests;
+  int compile_nice = 0;             // Priority (nice level) for compilers (lowered for deferred tests).
+  History history;                  // Results from previous submissions (if ${history} is set).
+  Job job;                          // Identity of this run, so newer submissions can cancel it.
+  FixturePack pack;                 // Inputs and expected outputs shared by testcases (if ${pack} is set).
+  emp::vector<Fixture> fixtures;    // Setup code shared by testcases (from :Fixture commands).
+  Metrics metrics;                  // Grader health metrics (written to ${metrics_file}, if set).
+  emp::vector<Leaderboard> leaderboards; // Class leaderboards to submit results to.
+  emp::String refresh_reference;    // Reference solution to rebuild expected outputs with (refresh mode).
+  size_t refresh_jobs = 1;          // Number of reference runs at once in refresh mode.
+  bool refresh_use_cache = true;    // Can refresh mode reuse cached reference outputs?
 
   std::map<emp::String, emp::String> var_map; // Map of all usable variables.
 
@@ -94,6 +139,20 @@ private:
     return setting_map;
   }
 
+  // If a setting is a target for a performance metric (e.g., "latency_p95_full"), load it in.
+  bool SetMetricTarget(Testcase & test, const std::string & arg, const std::string & value) {
+    const size_t split_pos = arg.rfind('_');
+    if (split_pos == std::string::npos) return false;
+    const std::string metric_name = arg.substr(0, split_pos);
+    const std::string target = arg.substr(split_pos+1);
+    if (!PerfMetric::IsMetric(metric_name) || (target != "full" && target != "zero")) return false;
+
+    PerfMetric & metric = test.GetMetric(metric_name);
+    const bool success = (target == "full") ? metric.SetFull(value) : metric.SetZero(value);
+    emp::notify::TestError(!success, "Invalid value '", value, "' for :Testcase setting '", arg, "'.");
+    return true;
+  }
+
   // Take an input line and fill out any variables, as needed.
   emp::String ApplyVars(const emp::String & line) {
     size_t next_pos = 0, var_start = 0;
@@ -121,6 +180,20 @@ private:
     is_init = true;
     LoadVars(args);
 
+    // If this run is for a named job, take it over from any older run still going.
+    if (var_map["job"].size() && refresh_reference.empty() && job.Claim(var_map["jobs_dir"], var_map["job"])) {
+      std::cout << "Cancelled older run of job '" << var_map["job"] << "'." << std::endl;
+    }
+
+    metrics.SetFile(var_map["metrics_file"]);
+
+    // Map in the fixture pack, if there is one.
+    if (var_map["pack"].size()) {
+      emp::notify::TestError(!pack.Open(var_map["pack"]),
+        "Unable to load fixture pack '", var_map["pack"], "'.");
+      std::cout << "Loaded " << pack.GetSize() << " fixtures from pack '" << var_map["pack"] << "'." << std::endl;
+    }
+
     // Make sure ${DIR} exists.
     emp::String dir_name = var_map["dir"];
     if (!std::filesystem::exists(static_cast<std::string>(dir_name))) {
@@ -182,6 +255,7 @@ private:
     var_map["exe"] =     file_base + ".exe";
     var_map["out"] =     file_base + "-output.txt";
     var_map["result"] =  file_base + "-result.txt";
+    test.heartbeat_filename = file_base + "-heartbeat.bin";
 
     // Allow these to be overwritten by settings, and then lock them into the testcase.
     auto setting_map = LoadVars(args);
@@ -196,23 +270,243 @@ private:
       if (value.size() && value[0] == '\"') value = emp::from_literal_string(value);
 
       if (arg == "args") test.args = value;
+      else if (arg == "aslr") test.aslr = ParseBool(value, "aslr");
+      else if (arg == "build_stats") test.build_stats = ParseBool(value, "build_stats");
       else if (arg == "code_file") test.code_filename = value;
+      else if (arg == "compare_files") {
+        std::stringstream ss(static_cast<std::string>(value));
+        std::string entry;
+        while (std::getline(ss, entry, ',')) {
+          const size_t colon_pos = entry.find(':');
+          emp::notify::TestError(colon_pos == std::string::npos, "Test case ", test.id,
+            " has compare_files entry '", entry, "'; expected 'produced_file:expected_file'.");
+          emp::String produced(entry.substr(0, colon_pos)), expected(entry.substr(colon_pos+1));
+          produced.Trim();
+          expected.Trim();
+          test.compare_files.emplace_back(produced, expected);
+        }
+      }
       else if (arg == "exit_code") test.expect_exit_code = value.As<int>();
       else if (arg == "expect") test.expect_filename = value;
+      else if (arg == "fixture") test.fixture = value;
       else if (arg == "hidden") test.hidden = ParseBool(value, "hidden");
       else if (arg == "input") test.input_filename = value;
+      else if (arg == "input_gen") test.input_gen = value;
+      else if (arg == "io_stats") test.io_stats = ParseBool(value, "io_stats");
+      else if (arg == "latency") test.latency_mode = ParseBool(value, "latency");
       else if (arg == "match_case") test.match_case = ParseBool(value, "match_case");
       else if (arg == "match_space") test.match_space = ParseBool(value, "match_space");
       else if (arg == "name") test.name = value;
       else if (arg == "output") test.output_filename = value;
+      else if (arg == "pin_cpu") test.pin_cpu = emp::from_string<int>(value);
       else if (arg == "points") test.points = emp::from_string<double>(value);
+      else if (arg == "reference") test.reference_command = value;
+      else if (arg == "repeat_ci") test.repeat_ci = emp::from_string<double>(value);
+      else if (arg == "repeat_max") test.repeat_max = emp::from_string<size_t>(value);
+      else if (arg == "repeat_min") test.repeat_min = emp::from_string<size_t>(value);
+      else if (arg == "repeat_warmup") test.repeat_warmup = emp::from_string<size_t>(value);
+      else if (arg == "rerun_margin") test.rerun_margin = emp::from_string<double>(value);
       else if (arg == "result") test.result_filename = value;
       else if (arg == "run_main") test.call_main = ParseBool(value, "run_main");
+      else if (arg == "symbol_sizes") test.symbol_sizes = emp::from_string<size_t>(value);
+      else if (arg == "throughput") test.throughput_mode = ParseBool(value, "throughput");
       else if (arg == "timeout") test.timeout = emp::from_string<size_t>(value);
+      else if (arg == "warmup") test.warmup = emp::from_string<double>(value);
+      else if (SetMetricTarget(test, arg, value)) { } // Performance target already set.
       else {
         emp::notify::Error("Unknown :Testcase argument '", arg, "'.");
       }
     }
+
+    test.pack = &pack;
+    if (test.fixture.size()) {
+      emp::notify::TestError(!FindFixture(test.fixture),
+        "Test case ", test.id, " uses fixture '", test.fixture, "', which has not been defined.");
+      emp::notify::TestError(test.args.size(),
+        "Test case ", test.id, " uses a fixture, so it cannot have command-line 'args'.");
+      emp::notify::TestError(test.metrics.size() || test.latency_mode || test.throughput_mode ||
+                             test.reference_command.size() || test.build_stats || test.io_stats ||
+                             test.symbol_sizes,
+        "Test case ", test.id, " uses a fixture, so it cannot measure performance or build statistics.");
+      test.call_main = false;  // Testcases run inside the fixture process, never main().
+    }
+    if (test.compare_files.size()) {
+      emp::notify::TestError(test.fixture.size() || test.latency_mode || test.throughput_mode,
+        "Test case ", test.id, " uses compare_files, so it cannot use a fixture, latency, or throughput.");
+      // The executable runs in its own directory, so files it shares with Emperfect need full paths.
+      test.work_dir = std::filesystem::absolute(static_cast<std::string>(file_base + "-work")).string();
+      test.result_filename = std::filesystem::absolute(static_cast<std::string>(test.result_filename)).string();
+      test.heartbeat_filename = std::filesystem::absolute(static_cast<std::string>(test.heartbeat_filename)).string();
+    }
+    emp::vector<emp::String> fixture_files = { test.input_filename, test.expect_filename };
+    for (const auto & [produced, expected] : test.compare_files) fixture_files.push_back(expected);
+    for (const emp::String & filename : fixture_files) {
+      emp::notify::TestError(FixturePack::IsPacked(filename) && !pack.Has(filename),
+        "Test case ", test.id, " uses fixture '", filename, "', but it is not in the fixture pack",
+        (pack.IsOpen() ? "." : " (no 'pack' was set in :Init)."));
+    }
+    emp::notify::TestError(test.warmup < 0.0 || test.warmup >= 1.0,
+      "Test case ", test.id, " has warmup=", test.warmup, "; must be at least 0.0 and less than 1.0.");
+    for (const auto & [name, metric] : test.metrics) {
+      emp::notify::TestError(metric.NeedsReference() && metric.IsBuildMetric(),
+        "Test case ", test.id, " has a target for '", name, "' relative to a reference, but build metrics cannot use one.");
+      emp::notify::TestError(metric.NeedsReference() && test.reference_command.empty(),
+        "Test case ", test.id, " has a target for '", name, "' relative to a reference, but no 'reference'.");
+    }
+  }
+
+  // Run the compile rules on other files (in place of ${cpp}, ${exe}, and ${compile} for the
+  // current test), stopping at the first failure.  Returns the exit code.
+  int RunCompileLines(const emp::String & cpp, const emp::String & exe, const emp::String & compile_out) {
+    auto saved_vars = var_map;
+    var_map["cpp"] = cpp;
+    var_map["exe"] = exe;
+    var_map["compile"] = compile_out;
+
+    int exit_code = 0;
+    for (emp::String line : compile) {
+      exit_code = RunCompileLine(ApplyVars(line))->GetExitCode();
+      if (exit_code) break;
+    }
+
+    var_map = saved_vars;
+    return exit_code;
+  }
+
+  // Hash a source file along with any local files it includes (e.g., #include "helpers.hpp").
+  uint64_t HashSourceFile(const std::filesystem::path & path, uint64_t hash,
+                          std::set<std::filesystem::path> & visited) {
+    if (!visited.insert(path.lexically_normal()).second) return hash;
+    std::ifstream file(path);
+    emp::notify::TestError(!file, "Unable to read shared source file '", path.string(), "'.");
+    std::stringstream ss;
+    ss << file.rdbuf();
+    const std::string code = ss.str();
+    hash = HashFNV1a(path.string() + '\n' + code, hash);
+
+    std::stringstream lines(code);
+    std::string line;
+    while (std::getline(lines, line)) {
+      const size_t include_pos = line.find("#include \"");
+      if (include_pos == std::string::npos) continue;
+      const size_t start = include_pos + 10;
+      const size_t end = line.find('"', start);
+      if (end == std::string::npos) continue;
+      const auto include_path = path.parent_path() / line.substr(start, end - start);
+      if (std::filesystem::exists(include_path)) hash = HashSourceFile(include_path, hash, visited);
+    }
+    return hash;
+  }
+
+  // Directory where compiled shared sources are cached (${shared_cache}, or ${dir}/shared).
+  std::string GetSharedCacheDir() {
+    if (var_map["shared_cache"].size()) return static_cast<std::string>(var_map["shared_cache"]);
+    return static_cast<std::string>(var_map["dir"] + "/shared");
+  }
+
+  // Compile instructor-provided sources (listed in ${shared}) with ${shared_compile} into objects
+  // that every test can link against with ${shared_objects}.  Objects are cached by a hash of
+  // their source (and any local includes) and the compile command, so each one is only built
+  // once per cache directory.
+  void BuildSharedSources() {
+    emp::String objects;
+    std::stringstream sources(static_cast<std::string>(var_map["shared"]));
+    std::string source;
+    while (sources >> source) {
+      const emp::String compile_rule = var_map["shared_compile"];
+      std::set<std::filesystem::path> visited;
+      const uint64_t hash = HashSourceFile(source, HashFNV1a(compile_rule), visited);
+
+      const std::filesystem::path cache_dir = GetSharedCacheDir();
+      std::filesystem::create_directories(cache_dir);
+      std::stringstream name;
+      name << std::filesystem::path(source).stem().string() << "-" << std::hex << hash << ".o";
+      const std::string object = (cache_dir / name.str()).string();
+
+      if (std::filesystem::exists(object)) {
+        std::cout << "Using cached shared object: " << object << std::endl;
+        metrics.Add("emperfect_shared_cache_requests_total{result=\"hit\"}");
+      } else {
+        metrics.Add("emperfect_shared_cache_requests_total{result=\"miss\"}");
+        // Build under a temporary name so other graders never see a partial object file.
+        const std::string tmp_object = emp::to_string(object, ".tmp", getpid());
+        const emp::String command = emp::to_string(compile_rule, " ", source, " -o ", tmp_object);
+        const int exit_code = RunCompileLine(command)->GetExitCode();
+        emp::notify::TestError(exit_code != 0, "Unable to compile shared source '", source, "'.");
+        std::filesystem::rename(tmp_object, object);
+      }
+      if (objects.size()) objects += " ";
+      objects += object;
+    }
+    var_map["shared_objects"] = objects;
+  }
+
+  // Run a single compile rule, stopping the compiler (and anything it launched) if it goes past
+  // ${compile_timeout} seconds or its processes use more than ${compile_memory} together.
+  std::unique_ptr<Process> RunCompileLine(const emp::String & line) {
+    std::cout << line << std::endl;
+    const size_t timeout = emp::from_string<size_t>(var_map["compile_timeout"]);
+    double memory_limit = 0.0;
+    emp::notify::TestError(var_map["compile_memory"].size() &&
+      !PerfMetric::ParseValue(var_map["compile_memory"], PerfUnit::BYTES, memory_limit),
+      "Invalid compile_memory setting '", var_map["compile_memory"], "'.");
+
+    auto process = std::make_unique<Process>(line);
+    process->UseShell().SetMemoryLimit(static_cast<size_t>(memory_limit)).SetNice(compile_nice);
+    if (process->Start()) {
+      process->Wait(timeout ? Process::clock_t::now() + std::chrono::seconds(timeout)
+                            : Process::time_point_t::max());
+    }
+    if (process->HitTimeout()) metrics.Add("emperfect_timeouts_total{phase=\"compile\"}");
+    if (process->HitMemoryLimit()) metrics.Add("emperfect_memory_limit_kills_total{phase=\"compile\"}");
+    return process;
+  }
+
+  // Describe which compile limit (if any) a compile rule was stopped for.
+  emp::String DescribeCompileLimit(const Process & process) {
+    if (process.HitTimeout()) {
+      return emp::to_string("time limit of ", var_map["compile_timeout"], " seconds");
+    }
+    if (process.HitMemoryLimit()) return emp::to_string("memory limit of ", var_map["compile_memory"]);
+    return "";
+  }
+
+  // Try to compile an expression as a constant (using the normal compile rules) to see if it
+  // can be evaluated at compile time, and how long the compiler took to do so.
+  ConstexprResult ProbeConstexpr(Testcase & test, const emp::String & header_code,
+                                 const emp::String & expression) {
+    ConstexprResult result;
+    emp::String file_base = emp::to_string(var_map["dir"], "/Test", test.id,
+                                           "-constexpr", test.constexpr_probes++);
+    std::ofstream probe_file(file_base + ".cpp");
+    probe_file << header_code << "\n"
+               << "constexpr auto _emperfect_constexpr_probe = (" << expression << ");\n";
+    probe_file.close();
+
+    // Compile the probe (with added flags to check it without linking, since it has no main(),
+    // and for a time report).
+    const auto start_time = std::chrono::steady_clock::now();
+    const int exit_code = RunCompileLines(emp::to_string(file_base, ".cpp ", var_map["constexpr_flags"]),
+                                          file_base + ".exe", file_base + "-compile.txt");
+    result.success = (exit_code == 0);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    // Scan compiler output for errors and the time spent on constant evaluation (GCC format:
+    // " constant expression evaluation   :   0.12 (  4%)   0.00 (  0%) ...")
+    emp::File compile_output(file_base + "-compile.txt");
+    for (emp::String line : compile_output) {
+      if (result.error.empty() && line.find("error:") != emp::String::npos) result.error = line;
+      const size_t label_pos = line.find("constant expression evaluation");
+      const size_t colon_pos = line.find(':', label_pos);
+      if (label_pos != emp::String::npos && colon_pos != emp::String::npos) {
+        result.seconds = std::strtod(line.substr(colon_pos+1).c_str(), nullptr);
+        result.from_report = true;
+      }
+    }
+
+    std::cout << "CHECK_CONSTEXPR(" << expression << "): "
+              << (result.success ? "constant" : "NOT constant") << std::endl;
+    return result;
   }
 
   void GenerateTestCPP(Testcase & test) {
@@ -222,69 +516,630 @@ private:
     // Add user-provided headers.
     std::stringstream processed_header;
     for (const auto & line : header) processed_header << ApplyVars(line) << "\n";
+    const emp::String header_code = processed_header.str();
 
-    test.GenerateTestCPP(processed_header.str());
+    test.GenerateTestCPP(header_code, [this, &test, &header_code](const emp::String & expression){
+      return ProbeConstexpr(test, header_code, expression);
+    });
   }
 
   void CompileTestCPP(Testcase & test) {
+    double compile_time = 0.0;
+    size_t compile_memory = 0;
+
     // Add user-provided headers.
     for (emp::String line : compile) {
-      line = ApplyVars(line);
-      std::cout << line << std::endl;
-      test.compile_exit_code = std::system(line.c_str());
+      auto process = RunCompileLine(ApplyVars(line));
+      test.compile_exit_code = process->GetExitCode();
+      test.compile_limit = DescribeCompileLimit(*process);
+      compile_time += process->GetRunTime();
+      compile_memory = std::max(compile_memory, process->GetPeakMemory());
       std::cout << "Compile exit code: " << test.compile_exit_code << std::endl;
+      if (test.compile_limit.size()) std::cout << "Compile stopped at " << test.compile_limit << std::endl;
       if (test.compile_exit_code) break;
     }
+
+    metrics.Observe("emperfect_compile_seconds", compile_time);
+    SetBuildMetric(test, "compile_time", compile_time);
+    SetBuildMetric(test, "compile_mem", compile_memory);
+    if (test.compile_exit_code == 0) RecordBinarySize(test);
+  }
+
+  // Record a metric measured while building a test (if it is graded or build stats are on).
+  void SetBuildMetric(Testcase & test, const std::string & name, double value) {
+    if (test.build_stats || emp::Has(test.metrics, name)) test.GetMetric(name).SetValue(value);
+  }
+
+  // Measure the size of the executable and, if needed, of its object file and the functions in it.
+  void RecordBinarySize(Testcase & test) {
+    std::error_code error;
+    const auto exe_size = std::filesystem::file_size(static_cast<std::string>(test.exe_filename), error);
+    if (!error) SetBuildMetric(test, "exe_size", exe_size);
+
+    // The executable also holds the runtime and libraries, so compile the test on its own too.
+    if (test.build_stats || emp::Has(test.metrics, "obj_size")) {
+      emp::String file_base = emp::to_string(var_map["dir"], "/Test", test.id, "-obj");
+      const emp::String obj_filename = file_base + ".o";
+      std::filesystem::remove(static_cast<std::string>(obj_filename), error);
+      const int exit_code =
+        RunCompileLines(emp::to_string(test.cpp_filename, " ", var_map["object_flags"]),
+                        obj_filename, file_base + "-compile.txt");
+      const auto obj_size = std::filesystem::file_size(static_cast<std::string>(obj_filename), error);
+      if (exit_code == 0 && !error) SetBuildMetric(test, "obj_size", obj_size);
+      else std::cout << "Unable to compile an object file to measure obj_size." << std::endl;
+    }
+
+    const bool need_code = test.build_stats || emp::Has(test.metrics, "code_size");
+    if (!need_code && test.symbol_sizes == 0) return;
+
+    // List symbols with sizes, one per line: "<address> <size> <type> <name>" (in hex).
+    emp::String symbols_filename = emp::to_string(var_map["dir"], "/Test", test.id, "-symbols.txt");
+    emp::String command = emp::to_string(var_map["symbols"], " ", test.exe_filename,
+                                         " > ", symbols_filename, " 2>/dev/null");
+    if (std::system(command.c_str())) return;
+
+    std::ifstream file(symbols_filename);
+    std::string line;
+    std::vector<std::pair<std::string, size_t>> functions;
+    size_t code_size = 0;
+    while (std::getline(file, line)) {
+      std::stringstream ss(line);
+      std::string address, size, type, name;
+      if (!(ss >> address >> size >> type) || type.size() != 1) continue;
+      if (type != "T" && type != "t" && type != "W") continue;  // Only keep code.
+      std::getline(ss >> std::ws, name);
+      const size_t bytes = std::strtoul(size.c_str(), nullptr, 16);
+      code_size += bytes;
+      functions.emplace_back(name, bytes);
+    }
+    SetBuildMetric(test, "code_size", code_size);
+
+    std::stable_sort(functions.begin(), functions.end(),
+                     [](const auto & a, const auto & b){ return a.second > b.second; });
+    if (functions.size() > test.symbol_sizes) functions.resize(test.symbol_sizes);
+    test.largest_symbols = functions;
+  }
+
+  // Record the resources used by a finished process (for the test or its reference solution).
+  void RecordUsage(Testcase & test, const Process & process, bool is_reference=false) {
+    const size_t memory = process.GetPeakMemory();
+    const Process::IOCounts & io = process.GetIOCounts();
+    const std::map<std::string, size_t> io_values = {
+      { "read_calls", io.read_calls }, { "write_calls", io.write_calls },
+      { "bytes_read", io.bytes_read }, { "bytes_written", io.bytes_written },
+      { "voluntary_switches", process.GetVoluntarySwitches() },
+      { "involuntary_switches", process.GetInvoluntarySwitches() },
+    };
+    if (is_reference) {
+      if (emp::Has(test.metrics, "mem")) test.GetMetric("mem").SetReference(memory);
+      if (emp::Has(test.metrics, "run_time")) test.GetMetric("run_time").SetReference(process.GetRunTime());
+      for (const auto & [name, value] : io_values) {
+        if (emp::Has(test.metrics, name)) test.GetMetric(name).SetReference(value);
+      }
+      return;
+    }
+    test.peak_memory = memory;
+    test.run_time = process.GetRunTime();
+    metrics.Observe("emperfect_run_seconds", test.run_time);
+    if (emp::Has(test.metrics, "mem")) test.GetMetric("mem").SetValue(memory);
+    if (emp::Has(test.metrics, "run_time")) test.GetMetric("run_time").SetValue(process.GetRunTime());
+    for (const auto & [name, value] : io_values) {
+      if (test.io_stats || emp::Has(test.metrics, name)) test.GetMetric(name).SetValue(value);
+    }
+    std::cout << "Peak memory: " << PerfMetric::FormatValue(memory, PerfUnit::BYTES) << std::endl;
+  }
+
+  // Configure a process with the settings a testcase uses to reduce measurement noise.
+  void ApplyRunSettings(const Testcase & test, Process & process) {
+    process.SetCPU(test.pin_cpu).SetASLR(test.aslr);
+    process.SetEnv("EMPERFECT_HEARTBEAT", test.heartbeat_filename);
+  }
+
+  // Clear the heartbeat file that the test executable updates as it runs each check.
+  void ResetHeartbeat(const Testcase & test) {
+    const long long heartbeat[4] = {0, 0, 0, 0};
+    std::ofstream(test.heartbeat_filename, std::ios::binary)
+      .write(reinterpret_cast<const char *>(heartbeat), sizeof(heartbeat));
+  }
+
+  // Find out which check a halted test executable was in the middle of.
+  void ReadHeartbeat(Testcase & test) {
+    long long heartbeat[4] = {0, 0, 0, 0};
+    std::ifstream(test.heartbeat_filename, std::ios::binary)
+      .read(reinterpret_cast<char *>(heartbeat), sizeof(heartbeat));
+    test.timeout_check = heartbeat[0] - 1;
+    test.last_check = heartbeat[1] - 1;
+    test.checks_finished = static_cast<size_t>(heartbeat[2]);
+    test.checks_passed = static_cast<size_t>(heartbeat[3]);
+    if (test.timeout_check >= 0) {
+      std::cout << "...Timed out during CHECK #" << test.timeout_check << "." << std::endl;
+    }
+  }
+
+  // Feed a test's input to a process, straight from memory if it is in the fixture pack.
+  void SetProcessInput(const Testcase & test, Process & process) {
+    if (!FixturePack::IsPacked(test.input_filename)) {
+      process.SetInputFile(test.input_filename);
+      return;
+    }
+    const int fd = pack.OpenMemFD(test.input_filename);
+    emp::notify::TestError(fd < 0, "Unable to provide fixture '", test.input_filename,
+                           "' as input for test case ", test.id, ".");
+    process.SetInputFD(fd);
+  }
+
+  // A reference solution could not be measured (e.g., it timed out on a busy grader).  Rather than
+  // stopping the grading, leave any metrics relative to it ungraded.
+  void SkipReference(Testcase & test, const emp::String & reason) {
+    emp::notify::Warning("Reference solution for test case ", test.id, " ", reason,
+                         "; metrics relative to it will not be graded.");
+    for (auto & [name, metric] : test.metrics) metric.ClearReference();
+  }
+
+  // Run a reference solution on the same inputs as the test, to measure its resource usage.
+  void RunReference(Testcase & test) {
+    emp::String run_command = test.reference_command;
+    if (test.args.size()) run_command += emp::to_string(" ", test.args);
+    std::cout << run_command << " (reference)" << std::endl;
+
+    Process process(run_command);
+    process.SetOutputFile("/dev/null").SetErrorFile("/dev/null");
+    SetProcessInput(test, process);
+    ApplyRunSettings(test, process);
+    if (!process.Start()) { SkipReference(test, "could not be started"); return; }
+    process.Wait(Process::clock_t::now() + std::chrono::seconds(test.timeout));
+    if (process.HitTimeout()) { SkipReference(test, "did not finish within the timeout"); return; }
+    RecordUsage(test, process, true);
+  }
+
+  // Recompile a test with the compiler's optimization report turned on and use it to evaluate
+  // any CHECK_VECTORIZED or CHECK_INLINED checks.  Nothing is executed.
+  void AnalyzeOptimization(Testcase & test) {
+    emp::String file_base = emp::to_string(var_map["dir"], "/Test", test.id, "-opt");
+    emp::String report_filename = file_base + "-report.txt";
+    std::filesystem::remove(static_cast<std::string>(report_filename));
+    const int exit_code =
+      RunCompileLines(emp::to_string(test.cpp_filename, " ", var_map["opt_flags"],
+                                     " -fopt-info-vec-inline-all=", report_filename),
+                      file_base + ".exe", file_base + "-compile.txt");
+
+    OptReport report;
+    report.Load(report_filename);
+    std::cout << "Optimization report: " << report.GetNumRemarks() << " remarks." << std::endl;
+
+    for (auto & check : test.checks) {
+      if (check.GetType() != CheckType::VECTORIZED && check.GetType() != CheckType::INLINED) continue;
+      const std::string function = check.GetTest().GetLHS();
+      const emp::String optimization = check.GetTest().GetRHS();
+      const bool vectorize = (check.GetType() == CheckType::VECTORIZED);
+      const bool success = (exit_code == 0) &&
+        (vectorize ? report.IsVectorized(function) : report.IsInlined(function));
+
+      check.PushResult(success);
+      check.PushLHSValue(success ? optimization : emp::to_string("not ", optimization));
+      check.PushRHSValue(optimization);
+      if (success) { check.PushErrorMsg(""); continue; }
+
+      // Explain the failure, including up to a few of the compiler's reasons.
+      std::string message = check.GetStaticErrorMsg();
+      if (exit_code) message += " Unable to compile with optimization report.";
+      auto reasons = vectorize ? report.GetMissedVectorization(function)
+                               : report.GetMissedInlining(function);
+      if (reasons.size() > 5) reasons.resize(5);
+      for (size_t i = 0; i < reasons.size(); ++i) {
+        message += (i == 0) ? " Compiler: " : "; ";
+        message += reasons[i];
+      }
+      check.PushErrorMsg(message);
+    }
+  }
+
+  // Disassemble the compiled test executable to evaluate any CHECK_CODEGEN checks.  Nothing
+  // is executed.
+  void AnalyzeMachineCode(Testcase & test) {
+    emp::String listing_filename = emp::to_string(var_map["dir"], "/Test", test.id, "-disasm.txt");
+    emp::String command = emp::to_string(var_map["disassemble"], " ", test.exe_filename,
+                                         " > ", listing_filename, " 2>/dev/null");
+    const int exit_code = std::system(command.c_str());
+
+    Disassembly code;
+    code.Load(listing_filename);
+    std::cout << "Disassembly: " << code.GetNumFunctions() << " functions." << std::endl;
+
+    for (auto & check : test.checks) {
+      if (check.GetType() != CheckType::CODEGEN) continue;
+      const emp::String property = check.GetTest().GetRHS();
+      const auto functions = code.Find(check.GetTest().GetLHS());
+
+      bool success = false;
+      emp::String found;                   // What was found in the machine code.
+      std::vector<std::string> offenders;  // Instructions that break the rule.
+      if (exit_code || functions.empty()) {
+        found = exit_code ? "(unable to disassemble)" : "(function not found)";
+      }
+      else if (const size_t limit = CheckInfo::GetMaxInstructions(property)) {
+        size_t count = 0;
+        for (const auto * function : functions) {
+          count = std::max(count, function->instructions.size());
+        }
+        success = (count <= limit);
+        found = emp::to_string(count, " instructions");
+      }
+      else {
+        const bool alloc = (property == "no_alloc");
+        for (const auto * function : functions) {
+          auto matches = function->Collect(alloc ? FunctionCode::IsAlloc : FunctionCode::IsCall);
+          offenders.insert(offenders.end(), matches.begin(), matches.end());
+        }
+        success = offenders.empty();
+        found = success ? property : emp::to_string(offenders.size(), alloc ? " allocations" : " calls");
+      }
+
+      check.PushResult(success);
+      check.PushLHSValue(found);
+      check.PushRHSValue(property);
+      if (success) { check.PushErrorMsg(""); continue; }
+
+      // Explain the failure, including up to a few of the offending instructions.
+      std::string message = check.GetStaticErrorMsg();
+      if (exit_code) message += " Unable to disassemble the executable.";
+      else if (functions.empty()) {
+        message += " Function not found in executable; it may have been inlined into every caller.";
+      }
+      if (offenders.size() > 5) offenders.resize(5);
+      for (size_t i = 0; i < offenders.size(); ++i) {
+        message += (i == 0) ? " Found: " : "; ";
+        message += offenders[i];
+      }
+      check.PushErrorMsg(message);
+    }
   }
 
   bool RunTestExe(Testcase & test) {
-    emp::String run_command = emp::to_string("timeout ", test.timeout, " ./", test.exe_filename);
+    emp::String run_command = emp::to_string("./", test.exe_filename);
+    if (test.work_dir.size()) {
+      run_command = std::filesystem::absolute(static_cast<std::string>(test.exe_filename)).string();
+    }
     if (test.args.size()) run_command += emp::to_string(" ", test.args);
-    if (test.input_filename.size()) run_command += emp::to_string(" < ", test.input_filename);
-    run_command += emp::to_string(" > ", test.output_filename, " 2> ", test.error_filename);
     std::cout << run_command << std::endl;
-    test.run_exit_code = std::system(run_command.c_str()); // % 256;
-    // Timeout exit code may be first byte or second byte.
-    test.hit_timeout = test.run_exit_code % 256 == 124 || test.run_exit_code / 256 == 124;
-    test.run_exit_code /= 256;
+
+    Process process(run_command);
+    process.SetOutputFile(test.output_filename).SetErrorFile(test.error_filename);
+    SetProcessInput(test, process);
+    ApplyRunSettings(test, process);
+    if (test.work_dir.size()) {  // Start each run in an empty working directory.
+      std::error_code error;
+      std::filesystem::remove_all(static_cast<std::string>(test.work_dir), error);
+      std::filesystem::create_directories(static_cast<std::string>(test.work_dir), error);
+      process.SetWorkDir(test.work_dir);
+    }
+    if (process.Start()) {
+      process.Wait(Process::clock_t::now() + std::chrono::seconds(test.timeout));
+    }
+    test.hit_timeout = process.HitTimeout();
+    test.run_exit_code = process.GetExitCode();
     std::cout << "Executable exit code: " << test.run_exit_code << std::endl;
+    RecordUsage(test, process);
+
+    if (test.reference_command.size()) RunReference(test);
+
     if (test.run_exit_code == test.expect_exit_code) return true;
 
     if (test.hit_timeout) std::cout << "...Halted due to timeout." << std::endl;
     return false;
   }
 
-  // Make sure that the output for the executable matches any expected output.
-  void CompareTestResults(Testcase & test) {
-    if (test.expect_filename.size()) {
-      emp::File expect_output(test.expect_filename);
-      emp::File exe_output(test.output_filename);
+  // Stream the full input through a command, measuring how quickly it is processed once the
+  // warm-up portion has been accepted (so process start-up is not counted).
+  // Returns the process so its exit code and timeout status can be checked.
+  std::unique_ptr<Process> MeasureThroughput(const Testcase & test, const emp::String & command,
+                                             const emp::String & error_filename,
+                                             const std::string & input, std::string & output,
+                                             double & bytes_per_sec, double & records_per_sec)
+  {
+    // Find where the warm-up records end.
+    const size_t num_records = std::count(input.begin(), input.end(), '\n')
+                             + (input.size() && input.back() != '\n');
+    const size_t warmup_records = static_cast<size_t>(num_records * test.warmup);
+    size_t warmup_bytes = 0;
+    for (size_t i = 0; i < warmup_records; ++i) warmup_bytes = input.find('\n', warmup_bytes) + 1;
+
+    auto process = std::make_unique<Process>(command);
+    process->PipeInput().PipeOutput().SetErrorFile(error_filename);
+    ApplyRunSettings(test, *process);
+    const auto deadline = Process::clock_t::now() + std::chrono::seconds(test.timeout);
+    bytes_per_sec = records_per_sec = 0.0;
+    if (!process->Start()) return process;
+
+    auto measure_start = process->GetStartTime();
+    bool started = (warmup_bytes == 0);
+    const bool finished = process->Stream(input, output, deadline, [&](size_t bytes_written){
+      if (!started && bytes_written >= warmup_bytes) {
+        measure_start = Process::clock_t::now();
+        started = true;
+      }
+    });
+    const double measure_time =
+      std::chrono::duration<double>(Process::clock_t::now() - measure_start).count();
+    process->Wait(deadline);
+
+    if (finished && started && measure_time > 0.0) {
+      bytes_per_sec = (input.size() - warmup_bytes) / measure_time;
+      records_per_sec = (num_records - warmup_records) / measure_time;
+    }
+    return process;
+  }
+
+  // Stream a large input through the executable, recording bytes and records per second.
+  bool RunTestThroughput(Testcase & test) {
+    emp::notify::TestError(test.input_filename.empty(),
+      "Test case ", test.id, " uses throughput mode, but has no 'input' or 'input_gen'.");
 
-      if (test.match_case == false) {
-        expect_output.Apply(emp::to_lower);
-        exe_output.Apply(emp::to_lower);
+    emp::String run_command = emp::to_string("./", test.exe_filename);
+    if (test.args.size()) run_command += emp::to_string(" ", test.args);
+    std::cout << run_command << " (throughput mode)" << std::endl;
+
+    const std::string input = test.ReadFixture(test.input_filename);
+
+    std::string output;
+    double bytes_per_sec, records_per_sec;
+    auto process = MeasureThroughput(test, run_command, test.error_filename, input, output,
+                                     bytes_per_sec, records_per_sec);
+    std::ofstream(test.output_filename) << output;
+
+    test.hit_timeout = process->HitTimeout();
+    test.run_exit_code = process->GetExitCode();
+    std::cout << "Executable exit code: " << test.run_exit_code << std::endl;
+    RecordUsage(test, *process);
+    if (bytes_per_sec > 0.0) {
+      test.GetMetric("bytes_per_sec").SetValue(bytes_per_sec);
+      test.GetMetric("records_per_sec").SetValue(records_per_sec);
+    }
+
+    // If there is a reference solution, measure it the same way for comparison.
+    if (test.reference_command.size()) {
+      std::cout << test.reference_command << " (throughput reference)" << std::endl;
+      std::string ref_output;
+      auto ref_process = MeasureThroughput(test, test.reference_command, "/dev/null", input, ref_output,
+                                           bytes_per_sec, records_per_sec);
+      if (ref_process->HitTimeout()) SkipReference(test, "did not finish within the timeout");
+      else if (bytes_per_sec == 0.0) SkipReference(test, "did not produce a throughput measurement");
+      else {
+        test.GetMetric("bytes_per_sec").SetReference(bytes_per_sec);
+        test.GetMetric("records_per_sec").SetReference(records_per_sec);
+        RecordUsage(test, *ref_process, true);
       }
-      if (test.match_space == false) {
-        expect_output.RemoveWhitespace();
-        exe_output.RemoveWhitespace();
-      } else {
-        // We always at least remove completely blank lines before comparisons.
-        expect_output.RemoveEmpty();
-        exe_output.RemoveEmpty();
+    }
+
+    if (test.hit_timeout) std::cout << "...Halted due to timeout." << std::endl;
+    return !test.hit_timeout && test.run_exit_code == test.expect_exit_code;
+  }
+
+  // Run the command that builds the standard input for a test, saving it to a file.
+  void GenerateTestInput(Testcase & test) {
+    emp::notify::TestError(test.input_filename.size(),
+      "Test case ", test.id, " cannot have both 'input' and 'input_gen' settings.");
+    test.input_filename = emp::to_string(var_map["dir"], "/Test", test.id, "-input.txt");
+    emp::String gen_command = emp::to_string(test.input_gen, " > ", test.input_filename);
+    std::cout << gen_command << std::endl;
+    const int gen_exit_code = std::system(gen_command.c_str());
+    emp::notify::TestError(gen_exit_code, "Input generator for test case ", test.id,
+                           " failed with exit code ", gen_exit_code, ".");
+  }
+
+  // Send each request to a command on its own line, timing how long it takes for the matching
+  // line of output to come back.  Returns the process so its exit code and timeout status can be
+  // checked; total_time is measured from the first request to the last response.
+  std::unique_ptr<Process> MeasureLatency(const Testcase & test, const emp::String & command,
+                                          const emp::String & error_filename,
+                                          const emp::File & request_file, std::ostream & output,
+                                          std::vector<double> & latencies, double & total_time)
+  {
+    auto process = std::make_unique<Process>(command);
+    process->PipeInput().PipeOutput().SetErrorFile(error_filename);
+    ApplyRunSettings(test, *process);
+    const auto deadline = Process::clock_t::now() + std::chrono::seconds(test.timeout);
+    const auto first_send = Process::clock_t::now();
+    auto last_response = first_send;
+    latencies.resize(0);
+    if (process->Start()) {
+      std::string response;
+      for (const emp::String & request : request_file) {
+        const auto send_time = Process::clock_t::now();
+        if (!process->Write(static_cast<std::string>(request) + "\n", deadline)) break;
+        if (!process->ReadLine(response, deadline)) break;
+        last_response = Process::clock_t::now();
+        latencies.push_back( std::chrono::duration<double>(last_response - send_time).count() );
+        output << response << "\n";
       }
+      process->CloseInput();
+      output << process->ReadAll(deadline);
+    }
+    process->Wait(deadline);
+    total_time = std::chrono::duration<double>(last_response - first_send).count();
+    return process;
+  }
 
-      test.output_match = (expect_output == exe_output);
-      if (test.output_match) {
-        std::cout << "Output match: Passed!" << std::endl;
-      } else {
-        std::cout << "Output match: Failed." << std::endl;
-        expect_output.Write(std::cout);
-        std::cout << "---" << std::endl;
-        exe_output.Write(std::cout);
+  // Record the latency percentiles (and response rate) from one latency-mode run.
+  void SetLatencyMetrics(Testcase & test, const std::vector<double> & latencies,
+                         double total_time, bool is_reference=false) {
+    auto set_value = [&test, is_reference](const std::string & name, double value) {
+      if (is_reference) test.GetMetric(name).SetReference(value);
+      else test.GetMetric(name).SetValue(value);
+    };
+    set_value("latency_p50", Percentile(latencies, 50.0));
+    set_value("latency_p95", Percentile(latencies, 95.0));
+    set_value("latency_p99", Percentile(latencies, 99.0));
+    if (total_time > 0.0) set_value("responses_per_sec", latencies.size() / total_time);
+  }
+
+  // Send each line of input to the executable as a separate request, timing how long it
+  // takes for the matching line of output to come back.
+  bool RunTestLatency(Testcase & test) {
+    emp::notify::TestError(test.input_filename.empty(),
+      "Test case ", test.id, " uses latency mode, but has no 'input' or 'input_gen' for requests.");
+
+    emp::String run_command = emp::to_string("./", test.exe_filename);
+    if (test.args.size()) run_command += emp::to_string(" ", test.args);
+    std::cout << run_command << " (latency mode)" << std::endl;
+
+    emp::File request_file = test.LoadFixture(test.input_filename);
+    std::ofstream output_file(test.output_filename);
+    std::vector<double> latencies;
+    double total_time = 0.0;
+    auto process = MeasureLatency(test, run_command, test.error_filename, request_file,
+                                  output_file, latencies, total_time);
+
+    test.hit_timeout = process->HitTimeout();
+    test.run_exit_code = process->GetExitCode();
+    std::cout << "Executable exit code: " << test.run_exit_code << std::endl;
+    RecordUsage(test, *process);
+    if (latencies.size()) SetLatencyMetrics(test, latencies, total_time);
+    std::cout << "Responses received: " << latencies.size() << " of " << request_file.size() << std::endl;
+
+    // If there is a reference solution, send it the same requests for comparison.
+    if (test.reference_command.size()) {
+      emp::String ref_command = test.reference_command;
+      if (test.args.size()) ref_command += emp::to_string(" ", test.args);
+      std::cout << ref_command << " (latency reference)" << std::endl;
+      std::ofstream ref_output("/dev/null");
+      auto ref_process = MeasureLatency(test, ref_command, "/dev/null", request_file, ref_output,
+                                        latencies, total_time);
+      if (ref_process->HitTimeout()) SkipReference(test, "did not finish within the timeout");
+      else if (latencies.size() < request_file.size()) {
+        SkipReference(test, "did not answer every request");
       }
+      else {
+        SetLatencyMetrics(test, latencies, total_time, true);
+        RecordUsage(test, *ref_process, true);
+      }
+    }
+
+    if (test.hit_timeout) std::cout << "...Halted due to timeout." << std::endl;
+    return !test.hit_timeout && test.run_exit_code == test.expect_exit_code;
+  }
+
+  // Run the executable once, in whichever mode the testcase uses.
+  bool RunTestOnce(Testcase & test) {
+    ResetHeartbeat(test);
+    bool success = false;
+    if (test.latency_mode) success = RunTestLatency(test);
+    else if (test.throughput_mode) success = RunTestThroughput(test);
+    else success = RunTestExe(test);
+    if (test.hit_timeout) {
+      ReadHeartbeat(test);
+      metrics.Add("emperfect_timeouts_total{phase=\"run\"}");
+    }
+    return success;
+  }
+
+  // Run a performance test repeatedly so that its measurements are robust to noise on the
+  // grader; each metric is set to its median.  Returns false if measurements did not settle.
+  bool RunTestMeasured(Testcase & test, size_t run_scale=1) {
+    Measurement measure(test.repeat_warmup, test.repeat_min * run_scale,
+                        test.repeat_max * run_scale, test.repeat_ci);
+    while (measure.NeedsMore() && !job.IsCancelled()) {
+      if (!RunTestOnce(test)) return true;  // A failed run needs no further measurement.
+
+      std::map<std::string, double> sample;
+      for (const auto & [name, metric] : test.metrics) {
+        if (metric.IsBuildMetric()) continue;  // Build metrics do not change between runs.
+        if (metric.IsMeasured()) sample[name] = metric.GetValue();
+        if (metric.HasReference()) sample["ref:" + name] = metric.GetReference();
+      }
+      measure.AddSample(sample);
     }
-    else {
-      test.output_match = true; // No output to match...
+
+    const bool converged = measure.IsConverged();
+    for (auto & [name, metric] : test.metrics) {
+      const MeasureSummary summary = measure.Summarize(name);
+      if (summary.count) {
+        metric.SetValue(summary.median, summary.low, summary.high, summary.count, !converged);
+        std::cout << name << ": " << metric.GetValueString() << std::endl;
+      }
+      const MeasureSummary ref_summary = measure.Summarize("ref:" + name);
+      if (ref_summary.count) metric.SetReference(ref_summary.median);
+    }
+    std::cout << "Measured " << measure.GetNumRuns() << " runs; "
+              << (converged ? "results are stable." : "results are noisy.") << std::endl;
+    return converged;
+  }
+
+  // Re-measure performance tests that were too noisy, rather than failing students for it.
+  // By now the other tests are done, so the grader should be quieter.
+  void RetryNoisyTests() {
+    for (size_t test_id : noisy_tests) {
+      if (job.IsCancelled()) return;
+      Testcase & test = tests[test_id];
+      std::cout << "Re-measuring test case " << test_id << " with more runs." << std::endl;
+
+      // Keep the first result (and the files from its last run) in case a retry run fails; a
+      // noisy grader should never turn a passing test into a failing one.
+      const Testcase first_result = test;
+      std::error_code error;
+      const emp::vector<std::string> run_files = { static_cast<std::string>(test.output_filename),
+        static_cast<std::string>(test.error_filename), static_cast<std::string>(test.result_filename) };
+      for (const auto & filename : run_files) {
+        std::filesystem::copy_file(filename, filename + ".first",
+                                   std::filesystem::copy_options::overwrite_existing, error);
+      }
+
+      RunTestMeasured(test, 2);
+      CompareTestResults(test);
+
+      const bool retry_failed =
+        test.hit_timeout || test.run_exit_code != test.expect_exit_code || !test.output_match;
+      for (const auto & filename : run_files) {
+        if (retry_failed) std::filesystem::rename(filename + ".first", filename, error);
+        else std::filesystem::remove(filename + ".first", error);
+      }
+      if (retry_failed) {
+        std::cout << "A retry run failed; keeping the first measurement." << std::endl;
+        test = first_result;
+      }
+    }
+    noisy_tests.resize(0);
+  }
+
+  // Compare one output against what was expected (which may be in the fixture pack), stopping
+  // at the first difference and noting where it was.  Returns true if they match.
+  bool CompareOutput(Testcase & test, const emp::String & label,
+                     const emp::String & actual_filename, const emp::String & expect_filename) {
+    std::unique_ptr<std::istream> expect;
+    if (FixturePack::IsPacked(expect_filename)) {
+      expect = std::make_unique<std::istringstream>(test.ReadFixture(expect_filename));
+    } else expect = std::make_unique<std::ifstream>(static_cast<std::string>(expect_filename));
+    std::ifstream actual(static_cast<std::string>(actual_filename));
+
+    const CompareResult result = OutputCompare(test.match_case, test.match_space).Compare(*expect, actual);
+    if (result.match) {
+      std::cout << label << " match: Passed!" << std::endl;
+      return true;
+    }
+    std::cout << label << " match: Failed (" << result.Describe() << ")." << std::endl;
+    test.output_mismatches.push_back(emp::to_string(label, ": ", result.Describe()));
+    return false;
+  }
+
+  // Make sure that the output for the executable matches any expected output.
+  void CompareTestResults(Testcase & test) {
+    test.output_match = true;
+    test.output_mismatches.resize(0);  // Tests may be compared again after being re-measured.
+    if (test.expect_filename.size()) {
+      test.output_match &= CompareOutput(test, "Output", test.output_filename, test.expect_filename);
+    }
+    for (const auto & [produced, expected] : test.compare_files) {
+      const emp::String label = emp::to_string("File '", produced, "'");
+      const emp::String path = emp::to_string(test.work_dir, "/", produced);
+      if (!std::filesystem::is_regular_file(static_cast<std::string>(path))) {
+        std::cout << label << " match: Failed (file was not written)." << std::endl;
+        test.output_mismatches.push_back(label + " was not written.");
+        test.output_match = false;
+        continue;
+      }
+      test.output_match &= CompareOutput(test, label, path, expected);
+    }
+    if (test.expect_filename.empty() && test.compare_files.empty()) {
       std::cout << "No output to match." << std::endl;
     }
   }
@@ -303,6 +1158,13 @@ private:
       else if (field == ":LHS:") test.checks[check_id].PushLHSValue(line);
       else if (field == ":RHS:") test.checks[check_id].PushRHSValue(line);
       else if (field == ":MSG:") test.checks[check_id].PushErrorMsg(line);
+      else if (field == ":TIME:") {
+        std::stringstream ss(line);
+        size_t id = 0;
+        CheckTiming timing;
+        ss >> id >> timing.count >> timing.total >> timing.min >> timing.max;
+        if (id < test.checks.size()) test.checks[id].SetTiming(timing);
+      }
       else if (field == "SCORE") {
         test.score = emp::from_string<double>(line);
         std::cout << "Score = " << test.score << " of " << test.points << std::endl;
@@ -328,10 +1190,18 @@ private:
 
     // Phase 2: Compile the generated CPP file, reporting back any errors.
     CompileTestCPP(test);
+    if (job.IsCancelled()) return;
+    if (test.compile_exit_code == 0 &&
+        (test.HasChecks(CheckType::VECTORIZED) || test.HasChecks(CheckType::INLINED))) {
+      AnalyzeOptimization(test);
+    }
+    if (test.compile_exit_code == 0 && test.HasChecks(CheckType::CODEGEN)) AnalyzeMachineCode(test);
 
     if (test.compile_exit_code == 0) {
       // Phase 3: Run the executable from the generated file, reporting back any errors.
-      RunTestExe(test);
+      if (test.input_gen.size()) GenerateTestInput(test);
+      if (!test.IsPerfTest()) RunTestOnce(test);
+      else if (!RunTestMeasured(test)) noisy_tests.push_back(test.id);
 
       // Phase 4: Compare any outputs produced, reporting back any differences in those outputs.
       CompareTestResults(test);
@@ -339,6 +1209,294 @@ private:
 
     // Phase 5: Record any necessary point calculations and feedback.
     RecordTestResults(test);
+    if (test.IsNearTimeout()) near_timeout_tests.push_back(test.id);
+    metrics.Add(emp::to_string("emperfect_tests_total{result=\"", test.Passed() ? "passed" : "failed", "\"}"));
+    metrics.Write();
+  }
+
+  // Rerun tests that timed out (or came close) now that the other tests are done and the grader
+  // should be quieter, so that load from other tests doesn't cost points.  The rerun decides the
+  // result; the first run is kept for the report.
+  void RerunNearTimeouts() {
+    for (size_t test_id : near_timeout_tests) {
+      if (job.IsCancelled()) return;
+      Testcase & test = tests[test_id];
+      std::cout << "Re-running test case " << test_id << " since it "
+                << (test.hit_timeout ? "timed out." : "was close to its timeout.") << std::endl;
+      test.reran = true;
+      test.first_run_time = test.run_time;
+      test.first_status = test.GetStatusString();
+      test.ClearResults();
+      if (!test.IsPerfTest()) RunTestOnce(test);
+      else RunTestMeasured(test);
+      CompareTestResults(test);
+      RecordTestResults(test);
+      std::cout << "Rerun result: " << test.GetStatusString()
+                << " (first run: " << test.first_status << ")" << std::endl;
+    }
+    near_timeout_tests.resize(0);
+  }
+
+  // Find a fixture by name (or nullptr if there is no such fixture).
+  Fixture * FindFixture(const emp::String & name) {
+    for (auto & fixture : fixtures) if (fixture.name == name) return &fixture;
+    return nullptr;
+  }
+
+  // Add a new Fixture; testcases attached to it are run once all configuration is read.
+  void AddFixture(const emp::String & args) {
+    emp::notify::TestError(compile.size() == 0, "Cannot set up fixture without compile rules.");
+
+    auto setting_map = LoadVars(args);
+    Fixture fixture;
+    for (auto [arg, value] : setting_map) {
+      if (value.size() && value[0] == '\"') value = emp::from_literal_string(value);
+
+      if (arg == "name") fixture.name = value;
+      else if (arg == "timeout") fixture.timeout = emp::from_string<size_t>(value);
+      else {
+        emp::notify::Error("Unknown :Fixture argument '", arg, "'.");
+      }
+    }
+    emp::notify::TestError(fixture.name.empty(), "Each :Fixture must have a 'name'.");
+    emp::notify::TestError(FindFixture(fixture.name), "Fixture '", fixture.name, "' defined twice.");
+
+    LoadCode(fixture.code);
+    fixture.vars = var_map;
+    fixture.header = header;
+    fixture.compile = compile;
+    fixtures.push_back(fixture);
+  }
+
+  // Set up a class leaderboard that this submission's performance results are added to.
+  void AddLeaderboard(const emp::String & args) {
+    if (!is_init) Init();
+
+    auto setting_map = LoadVars(args);
+    Leaderboard board;
+    board.SetParticipant(var_map["job"]);
+    bool anonymize = false;
+    emp::String salt;
+    for (auto [arg, value] : setting_map) {
+      if (value.size() && value[0] == '\"') value = emp::from_literal_string(value);
+
+      if (arg == "anonymize") anonymize = ParseBool(value, "anonymize");
+      else if (arg == "filename") board.SetFile(value);
+      else if (arg == "html") board.SetHTMLFile(value);
+      else if (arg == "metrics") {
+        std::vector<std::string> names;
+        std::stringstream ss(static_cast<std::string>(value));
+        std::string line;
+        while (std::getline(ss, line, ',')) {
+          emp::String name(line);
+          name.Trim();
+          emp::notify::TestError(!PerfMetric::IsMetric(name), "Unknown leaderboard metric '", name, "'.");
+          names.push_back(name);
+        }
+        board.SetMetrics(names);
+      }
+      else if (arg == "name") board.SetParticipant(value);
+      else if (arg == "rank_by") {
+        emp::notify::TestError(!PerfMetric::IsMetric(value), "Unknown leaderboard metric '", value, "'.");
+        board.SetRankBy(value);
+      }
+      else if (arg == "salt") salt = value;
+      else if (arg == "title") board.SetTitle(value);
+      else if (arg == "top") board.SetTop(emp::from_string<size_t>(value));
+      else {
+        emp::notify::Error("Unknown :Leaderboard argument '", arg, "'.");
+      }
+    }
+    board.SetAnonymize(anonymize, salt);
+    emp::notify::TestError(board.GetFilename().empty(), "Each :Leaderboard must have a 'filename'.");
+    emp::notify::TestError(board.GetParticipant().empty(),
+      "A :Leaderboard needs a 'name' to submit under (or set ${job}).");
+    leaderboards.push_back(board);
+  }
+
+  // Add this submission to each leaderboard, using the performance measured for its graded
+  // testcases.  Only correct submissions are ranked.
+  void UpdateLeaderboards() {
+    if (leaderboards.empty()) return;
+
+    // Combine each metric across testcases with a geometric mean so that no one testcase dominates.
+    std::map<std::string, std::vector<double>> samples;
+    size_t perf_tests = 0;
+    for (const auto & test : tests) {
+      // Every testcase must be correct, not just the timed ones; missing a target is fine.
+      if (!test.Passed() && test.GetStatus() != TestStatus::FAILED_PERF) {
+        std::cout << "Not added to leaderboard: test case " << test.id << " is not correct." << std::endl;
+        return;
+      }
+      const bool graded = test.IsPerfTest() || std::any_of(test.metrics.begin(), test.metrics.end(),
+        [](const auto & entry){ return entry.second.IsGraded(); });
+      if (!graded) continue;
+      ++perf_tests;
+      for (const auto & [name, metric] : test.metrics) {
+        if (metric.IsMeasured() && metric.GetValue() > 0.0) samples[name].push_back(metric.GetValue());
+      }
+    }
+    if (perf_tests == 0) return;
+
+    LeaderboardEntry entry;
+    for (const auto & [name, values] : samples) entry.values[name] = GeometricMean(values);
+    for (auto & board : leaderboards) {
+      entry.name = board.GetParticipant();
+      if (!board.Submit(entry)) {
+        emp::notify::Warning("Unable to update leaderboard '", board.GetFilename(), "'.");
+      }
+    }
+  }
+
+  // Build one executable for a fixture and all of its testcases, then run it: the setup code
+  // runs once and each testcase is run in a child forked from the resulting state.
+  void RunFixture(size_t fixture_id) {
+    Fixture & fixture = fixtures[fixture_id];
+    if (fixture.test_ids.empty()) return;
+    std::cout << "Running fixture '" << fixture.name << "' for "
+              << fixture.test_ids.size() << " test case(s)." << std::endl;
+
+    // Restore the configuration that was active when the fixture was read.
+    auto saved_vars = var_map;
+    auto saved_header = header;
+    auto saved_compile = compile;
+    var_map = fixture.vars;
+    header = fixture.header;
+    compile = fixture.compile;
+
+    const emp::String file_base = emp::to_string(var_map["dir"], "/Fixture", fixture_id);
+    const emp::String cpp_filename = file_base + ".cpp";
+    const emp::String exe_filename = file_base + ".exe";
+    const emp::String compile_filename = file_base + "-compile.txt";
+    const emp::String setup_filename = file_base + "-setup.txt";  // Written once setup finishes.
+    auto status_filename = [this](const Testcase & test){
+      return emp::to_string(var_map["dir"], "/Test", test.id, "-status.txt");
+    };
+
+    std::stringstream processed_header;
+    for (const auto & line : header) processed_header << ApplyVars(line) << "\n";
+    const emp::String header_code = processed_header.str();
+
+    // Phase 1: Generate a single CPP file with the setup code followed by every testcase.
+    std::cout << "Creating: " << cpp_filename << std::endl;
+    std::ofstream cpp_file(cpp_filename);
+    Testcase::PrintSupportCPP(cpp_file, header_code);
+    Fixture::PrintForkCPP(cpp_file);
+    cpp_file
+      << "void _emperfect_fixture() {\n"
+      << "  alarm(" << fixture.timeout << ");  // Limit the time for setup.\n"
+      << ApplyVars( emp::join(fixture.code, "\n") ) << "\n"
+      << "  alarm(0);\n"
+      << "  std::ofstream(\"" << setup_filename << "\") << \"SETUP done\\n\";\n\n";
+    size_t total_timeout = fixture.timeout;
+    for (size_t test_id : fixture.test_ids) {
+      Testcase & test = tests[test_id];
+      var_map["#test"] = emp::to_string(test.id);
+      test.processed_code = ApplyVars( emp::join(test.code, "\n") );
+      if (test.input_gen.size()) GenerateTestInput(test);
+      if (FixturePack::IsPacked(test.input_filename)) {  // The child needs its input as a file.
+        const emp::String input_filename = emp::to_string(var_map["dir"], "/Test", test.id, "-input.txt");
+        std::ofstream(input_filename) << test.ReadFixture(test.input_filename);
+        test.input_filename = input_filename;
+      }
+      test.GenerateFixtureCPP(cpp_file, status_filename(test),
+        [this, &test, &header_code](const emp::String & expression){
+          return ProbeConstexpr(test, header_code, expression);
+        });
+      emp::notify::TestError(test.HasChecks(CheckType::VECTORIZED) || test.HasChecks(CheckType::INLINED) ||
+                             test.HasChecks(CheckType::CODEGEN),
+        "Test case ", test.id, " uses a fixture, so it cannot use optimization or machine-code checks.");
+      total_timeout += test.timeout;
+    }
+    cpp_file
+      << "}\n\n"
+      << "// Build a fixture runner to be executed before main().\n"
+      << "struct _emperfect_runner {\n"
+      << "  _emperfect_runner() {\n"
+      << "    _emperfect_fixture();\n"
+      << "    exit(0); // Don't execute main().\n"
+      << "  }\n"
+      << "};\n\n"
+      << "static _emperfect_runner runner;\n";
+    cpp_file.close();
+
+    // Phase 2: Compile the fixture (shared by all of its testcases).
+    const auto compile_start = std::chrono::steady_clock::now();
+    const int compile_exit_code = RunCompileLines(cpp_filename, exe_filename, compile_filename);
+    metrics.Observe("emperfect_compile_seconds",
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - compile_start).count());
+    std::cout << "Compile exit code: " << compile_exit_code << std::endl;
+
+    // Phase 3: Run the fixture, which runs each testcase in turn.
+    std::unique_ptr<Process> process;
+    emp::String setup_error;  // How the setup code failed, if it did.
+    if (compile_exit_code == 0) {
+      std::error_code error;
+      std::filesystem::remove(static_cast<std::string>(setup_filename), error);
+      for (size_t test_id : fixture.test_ids) {
+        std::filesystem::remove(static_cast<std::string>(status_filename(tests[test_id])), error);
+      }
+      std::cout << "./" << exe_filename << " (fixture)" << std::endl;
+      process = std::make_unique<Process>(emp::to_string("./", exe_filename));
+      process->SetInputFile("/dev/null")
+              .SetOutputFile(file_base + "-output.txt")
+              .SetErrorFile(file_base + "-errors.txt");
+      if (process->Start()) {
+        process->Wait(Process::clock_t::now() + std::chrono::seconds(total_timeout));
+      }
+      std::cout << "Fixture exit code: " << process->GetExitCode() << std::endl;
+
+      // Make sure the setup code finished before blaming any testcase.
+      std::string setup_status;
+      std::ifstream(setup_filename) >> setup_status >> setup_status;
+      if (setup_status != "done") {
+        if (process->HitTimeout() || process->GetExitCode() == 128 + SIGALRM) {
+          setup_error = emp::to_string("timed out (limit ", fixture.timeout, " seconds)");
+        } else setup_error = emp::to_string("failed (exit code ", process->GetExitCode(), ")");
+        std::cout << "Fixture setup " << setup_error << "." << std::endl;
+      }
+    }
+
+    // Phases 4 and 5: Check the results of each testcase.
+    for (size_t test_id : fixture.test_ids) {
+      Testcase & test = tests[test_id];
+      test.pending = false;
+      test.cpp_filename = cpp_filename;
+      test.exe_filename = exe_filename;
+      test.compile_filename = compile_filename;
+      test.compile_exit_code = compile_exit_code;
+      test.fixture_error = setup_error;
+      if (compile_exit_code == 0 && setup_error.size()) {
+        std::cout << "Test case " << test.id << ": fixture setup " << setup_error << "." << std::endl;
+      } else if (compile_exit_code == 0) {
+        // If the fixture stopped before reaching a testcase, blame the fixture's exit.
+        test.run_exit_code = process->GetExitCode() ? process->GetExitCode() : -1;
+        test.hit_timeout = process->HitTimeout();
+        std::ifstream status_file(status_filename(test));
+        std::string field;
+        while (status_file >> field) {
+          if (field == "EXIT") status_file >> test.run_exit_code;
+          else if (field == "TIMEOUT") status_file >> test.hit_timeout;
+          else if (field == "TIME") status_file >> test.run_time;
+          else if (field == "MEMORY") status_file >> test.peak_memory;
+        }
+        std::cout << "Test case " << test.id << " exit code: " << test.run_exit_code << std::endl;
+        metrics.Observe("emperfect_run_seconds", test.run_time);
+        if (test.hit_timeout) {
+          std::cout << "...Halted due to timeout." << std::endl;
+          metrics.Add("emperfect_timeouts_total{phase=\"run\"}");
+        }
+        CompareTestResults(test);
+      }
+      RecordTestResults(test);
+      metrics.Add(emp::to_string("emperfect_tests_total{result=\"", test.Passed() ? "passed" : "failed", "\"}"));
+      metrics.Set("emperfect_queue_depth", CountPendingTests());
+    }
+    metrics.Write();
+
+    var_map = saved_vars;
+    header = saved_header;
+    compile = saved_compile;
   }
 
   // Add a new Testcase and run it.
@@ -350,6 +1508,23 @@ private:
     auto & test = tests.back();
     ConfigTestcase(test, args);
     LoadCode(test.code);
+    if (refresh_reference.size()) return;  // Only rebuilding expected outputs; nothing is run.
+
+    // Testcases with a fixture are run together with it, once all configuration has been read.
+    if (test.fixture.size()) {
+      test.pending = true;
+      FindFixture(test.fixture)->test_ids.push_back(test.id);
+      metrics.Set("emperfect_queue_depth", CountPendingTests());
+      return;
+    }
+
+    // Hidden tests may be put off until the visible results have been published.
+    if (test.hidden && ParseBool(var_map["defer_hidden"], "defer_hidden")) {
+      test.pending = true;
+      deferred_tests.push_back(DeferredTest{ test.id, var_map, header, compile });
+      metrics.Set("emperfect_queue_depth", CountPendingTests());
+      return;
+    }
     RunTest(test);
   }
 
@@ -357,8 +1532,28 @@ public:
   Emperfect() : file_scan(input_file) {
     // Initialize default values
     var_map["dir"] = ".emperfect";
+    var_map["archive"] = "";
+    var_map["archive_clean"] = "true";
     var_map["debug"] = "false";
     var_map["log"] = "Log.txt";
+    var_map["constexpr_flags"] = "-fsyntax-only -ftime-report";
+    var_map["opt_flags"] = "-O3";
+    var_map["object_flags"] = "-c";
+    var_map["disassemble"] = "objdump -d -C --no-show-raw-insn";
+    var_map["symbols"] = "nm -C -S --size-sort";
+    var_map["compile_timeout"] = "60";
+    var_map["compile_memory"] = "";
+    var_map["history"] = "";
+    var_map["job"] = "";
+    var_map["pack"] = "";
+    var_map["metrics_file"] = "";
+    var_map["defer_hidden"] = "false";
+    var_map["defer_nice"] = "10";
+    var_map["jobs_dir"] = "/tmp/emperfect-jobs";
+    var_map["shared"] = "";
+    var_map["shared_objects"] = "";
+    var_map["shared_cache"] = "";
+    var_map["shared_compile"] = "g++ -std=c++20 -c";
   }
 
   // Load test configurations from a stream.
@@ -368,7 +1563,7 @@ public:
     // NOTE: Do not change whitespace as it might matter for output code.
     
     // Loop through the file and process each line.
-    while (file_scan) {
+    while (file_scan && !job.IsCancelled()) {
       emp::String line = ApplyVars( file_scan.Read() );
       if (emp::is_whitespace(line)) continue;  // Skip empty lines.
 
@@ -378,8 +1573,10 @@ public:
 
       const emp::String command = emp::to_lower( emp::string_pop_word(line) );
       if (command == ":init") Init(line);
-      else if (command == ":compile") LoadCode(compile, line);
+      else if (command == ":compile") { LoadCode(compile, line); if (refresh_reference.empty()) BuildSharedSources(); }
+      else if (command == ":fixture") AddFixture(line);
       else if (command == ":header") LoadCode(header, line);
+      else if (command == ":leaderboard") AddLeaderboard(line);
       else if (command == ":output") AddOutput(line);
       else if (command == ":testcase") AddTestcase(line);
       else {
@@ -387,7 +1584,260 @@ public:
       }
     }
 
+    // In refresh mode, testcases were only read so their expected outputs could be rebuilt.
+    if (refresh_reference.size()) {
+      RefreshExpected();
+      return;
+    }
+
+    for (size_t fixture_id = 0; fixture_id < fixtures.size() && !job.IsCancelled(); ++fixture_id) {
+      RunFixture(fixture_id);
+    }
+    RetryNoisyTests();
+    RerunNearTimeouts();
+
+    // Publish student reports before running any deferred (hidden) tests.
+    if (deferred_tests.size() && !job.IsCancelled()) {
+      PrintResults(true);
+      RunDeferredTests();
+      RetryNoisyTests();
+      RerunNearTimeouts();
+    }
+
+    // If a newer submission took over, leave all reporting to it.
+    if (job.IsCancelled()) {
+      std::cout << "Run superseded by a newer submission; discarding results." << std::endl;
+      DiscardArtifacts();
+      metrics.Add("emperfect_runs_total{result=\"cancelled\"}");
+      metrics.Write(true);
+      return;
+    }
+
+    UpdateHistory();
+    UpdateLeaderboards();
     PrintResults();
+    ArchiveArtifacts();
+    metrics.Add("emperfect_runs_total{result=\"complete\"}");
+    metrics.Write(true);
+    job.Release();
+  }
+
+  // Remove the files generated for each testcase (e.g., when a run is cancelled part way).
+  void DiscardArtifacts() {
+    for (const auto & test : tests) {
+      for (const emp::String & filename : { test.cpp_filename, test.compile_filename, test.exe_filename,
+                                            test.output_filename, test.error_filename, test.result_filename }) {
+        std::error_code error;
+        std::filesystem::remove(static_cast<std::string>(filename), error);
+      }
+    }
+
+    // Also remove any extra files (e.g., "Test3-opt-report.txt" or "Test3-input.txt").
+    std::error_code error;
+    for (const auto & entry : std::filesystem::directory_iterator(static_cast<std::string>(var_map["dir"]), error)) {
+      const std::string name = entry.path().filename().string();
+      for (const auto & test : tests) {
+        const std::string prefix = emp::to_string("Test", test.id, "-");
+        if (name.starts_with(prefix)) { std::filesystem::remove_all(entry.path(), error); break; }
+      }
+      if (name.starts_with("Fixture")) std::filesystem::remove(entry.path(), error);
+    }
+  }
+
+  // Pack the generated sources, logs, and outputs into a compressed archive (if ${archive} is set).
+  // Executables are left out since they can be rebuilt from the sources.
+  void ArchiveArtifacts() {
+    const std::string archive_filename = var_map["archive"];
+    if (archive_filename.empty()) return;
+
+    // Finish writing all output files so their full contents are archived.
+    emp::vector<std::string> reports;
+    for (auto & output : outputs) {
+      if (output.GetFilename().empty()) continue;
+      output.Reset();
+      reports.push_back(output.GetFilename());
+    }
+
+    // Collect generated files, including those that tests wrote into their working directories.
+    // Caches (of shared objects, and of expected outputs from --refresh-expected) are left alone
+    // so later runs can still use them.
+    const std::string shared_cache = GetSharedCacheDir();
+    std::error_code error;
+    emp::vector<std::string> generated, executables;
+    auto is_report = [&reports, &error](const std::filesystem::path & path) {
+      return std::any_of(reports.begin(), reports.end(),
+                         [&](const std::string & report){ return std::filesystem::equivalent(path, report, error); });
+    };
+    for (auto it = std::filesystem::recursive_directory_iterator(static_cast<std::string>(var_map["dir"]), error);
+         it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+      if (it->is_directory(error)) {
+        if (it->path().filename() == "expected-cache"
+            || std::filesystem::equivalent(it->path(), shared_cache, error)) {
+          it.disable_recursion_pending();
+        }
+        continue;
+      }
+      if (!it->is_regular_file(error)) continue;
+      if (std::filesystem::equivalent(it->path(), archive_filename, error) || is_report(it->path())) continue;
+      // Executables and object files can be rebuilt from the archived sources.
+      const auto extension = it->path().extension();
+      if (extension == ".exe" || extension == ".o") executables.push_back(it->path().string());
+      else generated.push_back(it->path().string());
+    }
+    std::sort(generated.begin(), generated.end());
+    emp::vector<std::string> files = generated;
+    files.insert(files.end(), reports.begin(), reports.end());
+
+    if (!Archive::Write(archive_filename, files)) {
+      emp::notify::Warning("Unable to write artifact archive '", archive_filename, "'.");
+      return;
+    }
+    std::cout << "Archived " << files.size() << " files into '" << archive_filename << "'." << std::endl;
+
+    // Once archived, the generated files are no longer needed (reports stay for students to read).
+    if (ParseBool(var_map["archive_clean"], "archive_clean")) {
+      for (const auto & filename : generated) std::filesystem::remove(filename, error);
+      for (const auto & filename : executables) std::filesystem::remove(filename, error);
+      for (const auto & test : tests) {
+        if (test.work_dir.size()) std::filesystem::remove_all(static_cast<std::string>(test.work_dir), error);
+      }
+    }
+  }
+
+  bool WasCancelled() { return job.IsCancelled(); }
+
+  // Instead of grading, rebuild the expected output of every testcase by running a reference
+  // solution (on up to num_jobs testcases at once).
+  void SetRefreshExpected(const emp::String & reference, size_t num_jobs, bool use_cache=true) {
+    refresh_reference = reference;
+    refresh_jobs = std::max<size_t>(num_jobs, 1);
+    refresh_use_cache = use_cache;
+  }
+
+  // Hash the reference solution's command along with the contents of every file it names (e.g.,
+  // the executable, or the script in "python3 ref.py"), so cached outputs are thrown out whenever
+  // any of them changes.
+  uint64_t HashReference() const {
+    uint64_t hash = HashFNV1a(static_cast<std::string>(refresh_reference));
+    std::stringstream ss(static_cast<std::string>(refresh_reference));
+    std::string word;
+    char chunk[65536];
+    while (ss >> word) {
+      std::error_code error;
+      if (!std::filesystem::is_regular_file(word, error)) continue;
+      std::ifstream file(word, std::ios::binary);
+      while (file.read(chunk, sizeof(chunk)) || file.gcount()) {
+        hash = HashFNV1a(std::string_view(chunk, static_cast<size_t>(file.gcount())), hash);
+      }
+    }
+    return hash;
+  }
+
+  // Run the reference solution on each testcase's input and args, writing its output to the
+  // testcase's expected-output file.  Outputs are cached by the hash of the reference, the args,
+  // and the input, so only testcases that changed are run again.
+  void RefreshExpected() {
+    const std::string cache_dir = emp::to_string(var_map["dir"], "/expected-cache");
+    std::filesystem::create_directories(cache_dir);
+    const uint64_t reference_hash = HashReference();
+
+    // Find which testcases need the reference run; fill in the rest from the cache.  Testcases
+    // with the same input and args share a run (and a cache file).
+    struct RefreshJob {
+      std::string cache_filename;
+      emp::vector<size_t> test_ids;        // Testcases that need this output (the first is run).
+      emp::vector<std::string> messages;   // Problem with each testcase ("" if it was updated).
+    };
+    emp::vector<RefreshJob> todo;
+    size_t num_cached = 0, num_tests = 0;
+    std::atomic<size_t> num_failed = 0;
+    auto install = [](const std::string & from, const emp::String & to) {
+      const std::filesystem::path to_path(static_cast<std::string>(to));
+      std::error_code error;
+      if (to_path.has_parent_path()) std::filesystem::create_directories(to_path.parent_path(), error);
+      std::filesystem::copy_file(from, to_path, std::filesystem::copy_options::overwrite_existing, error);
+      return !error;
+    };
+    for (auto & test : tests) {
+      if (test.expect_filename.empty()) continue;
+      if (FixturePack::IsPacked(test.expect_filename)) {
+        std::cout << "Test case " << test.id << ": skipped; expected output '" << test.expect_filename
+                  << "' is in a fixture pack (rebuild the pack afterwards)." << std::endl;
+        continue;
+      }
+      if (test.input_gen.size()) GenerateTestInput(test);
+
+      uint64_t hash = HashFNV1a(static_cast<std::string>(test.args), reference_hash);
+      if (test.input_filename.size()) hash = HashFNV1a(test.ReadFixture(test.input_filename), hash);
+      char hash_string[20];
+      std::snprintf(hash_string, sizeof(hash_string), "%016llx", static_cast<unsigned long long>(hash));
+      const std::string cache_filename = cache_dir + "/" + hash_string + ".txt";
+
+      if (refresh_use_cache && std::filesystem::exists(cache_filename)
+          && install(cache_filename, test.expect_filename)) {
+        ++num_cached;
+        continue;
+      }
+      auto it = std::find_if(todo.begin(), todo.end(),
+        [&cache_filename](const auto & job){ return job.cache_filename == cache_filename; });
+      if (it == todo.end()) it = todo.insert(todo.end(), RefreshJob{ cache_filename, {}, {} });
+      it->test_ids.push_back(test.id);
+      it->messages.emplace_back();
+      ++num_tests;
+    }
+
+    // Run the reference for the remaining testcases, several at a time.
+    std::cout << "Running reference " << todo.size() << " time(s) for " << num_tests
+              << " test case(s) (" << num_cached << " cached) with " << refresh_jobs << " job(s)." << std::endl;
+    std::atomic<size_t> next_job = 0;
+    auto worker = [&]() {
+      for (size_t job_id = next_job++; job_id < todo.size(); job_id = next_job++) {
+        RefreshJob & refresh = todo[job_id];
+        const Testcase & test = tests[refresh.test_ids[0]];
+        emp::String command = refresh_reference;
+        if (test.args.size()) command += emp::to_string(" ", test.args);
+
+        const std::string tmp_filename = refresh.cache_filename + ".tmp";
+        Process process(command);
+        process.SetOutputFile(tmp_filename).SetErrorFile("/dev/null");
+        if (test.input_filename.size()) SetProcessInput(test, process);
+        if (process.Start()) process.Wait(Process::clock_t::now() + std::chrono::seconds(test.timeout));
+
+        std::string message;
+        if (process.HitTimeout()) message = "reference timed out";
+        else if (process.GetExitCode() != test.expect_exit_code) {
+          message = emp::to_string("reference exited with code ", process.GetExitCode(),
+                                   " (expected ", test.expect_exit_code, ")");
+        }
+        else if (std::rename(tmp_filename.c_str(), refresh.cache_filename.c_str()) != 0) {
+          message = emp::to_string("unable to write '", refresh.cache_filename, "'");
+        }
+        std::remove(tmp_filename.c_str());
+
+        // Install the output for every testcase that shares this run.
+        for (size_t i = 0; i < refresh.test_ids.size(); ++i) {
+          const emp::String & expect_filename = tests[refresh.test_ids[i]].expect_filename;
+          refresh.messages[i] = message;
+          if (message.empty() && !install(refresh.cache_filename, expect_filename)) {
+            refresh.messages[i] = emp::to_string("unable to write '", expect_filename, "'");
+          }
+          if (refresh.messages[i].size()) ++num_failed;
+        }
+      }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min(refresh_jobs, todo.size()); ++i) workers.emplace_back(worker);
+    for (auto & thread : workers) thread.join();
+
+    for (const auto & refresh : todo) {
+      for (size_t i = 0; i < refresh.test_ids.size(); ++i) {
+        std::cout << "Test case " << refresh.test_ids[i] << ": ";
+        if (refresh.messages[i].size()) std::cout << refresh.messages[i] << std::endl;
+        else std::cout << "updated '" << tests[refresh.test_ids[i]].expect_filename << "'" << std::endl;
+      }
+    }
+    std::cout << "Refreshed expected outputs: " << (num_tests - num_failed.load()) << " run, "
+              << num_cached << " from cache, " << num_failed << " failed." << std::endl;
   }
 
   void Load(emp::String filename) {
@@ -411,15 +1861,45 @@ public:
     return std::round( 100.0 * CountEarnedPoints() / CountTotalPoints() );
   }
 
+  // Add this submission to the student's history file (if one is being kept).
+  void UpdateHistory() {
+    const std::string filename = var_map["history"];
+    if (filename.empty()) return;
+
+    HistorySubmission submission;
+    submission.percent = GetPercentEarned();
+    for (const auto & test : tests) {
+      // Use the median run time for tests that were measured repeatedly.
+      auto it = test.metrics.find("run_time");
+      const double run_time = (it != test.metrics.end() && it->second.IsMeasured())
+                            ? it->second.GetValue() : test.run_time;
+      submission.tests[test.id] = HistoryEntry{ test.EarnedPoints(), run_time, test.peak_memory };
+    }
+    if (!history.Update(filename, submission)) {
+      emp::notify::Warning("Unable to save history file '", filename, "'.");
+    }
+  }
+
+  // Describe how a testcase has done across submissions (e.g., "time -12%  ▇▆▃▁").
+  emp::String GetTrendString(const Testcase & test) const {
+    return emp::to_string(history.GetChangeString(test.id), "  ",
+                          History::Sparkline(history.GetSeries(test.id, &HistoryEntry::run_time)));
+  }
+
   void PrintSummary_Text(std::ostream & out) {
     // Loop through test cases for printing to standard out.
     for (auto & test_case : tests) {
       out << test_case.id << " : " << test_case.name
           << " : passed " << test_case.CountPassed()
           << " of " << test_case.GetNumChecks() << " checks; "
-          << test_case.EarnedPoints() << " points." << std::endl;
+          << test_case.EarnedPoints() << " points.";
+      if (history.HasPrevious()) out << "  [" << GetTrendString(test_case) << "]";
+      out << std::endl;
     }
-    out << "\nFinal Score: " << GetPercentEarned() << std::endl;
+    out << (HasPendingTests() ? "\nScore So Far (some tests pending): " : "\nFinal Score: ")
+        << GetPercentEarned();
+    if (history.HasPrevious()) out << "  [" << History::Sparkline(history.GetPercentSeries()) << "]";
+    out << std::endl;
   }
   
   /// @brief Print out an HTML table summarizing results of each test.
@@ -427,11 +1907,13 @@ public:
   /// @param link_base Where should links go?
   ///        "#" is local, "file.html#" links to file.html. Empty-> don't create links.
   void PrintSummary_HTML(std::ostream & out, emp::String link_base="#") {
-    out << "<h2>Final Score: <span style=\"color: blue\">"
-        << GetPercentEarned() << "%</span></h2>\n" << std::endl;
+    out << "<h2>" << (HasPendingTests() ? "Score So Far (some tests pending)" : "Final Score")
+        << ": <span style=\"color: blue\">" << GetPercentEarned() << "%</span></h2>\n" << std::endl;
 
     out << "<table style=\"background-color:#3fc0FF;\" cellpadding=\"5px\" border=\"1px solid black\" cellspacing=\"0\">"
-        << "<tr><th>Test Case<th>Status<th>Checks<th>Passed<th>Failed<th>Score</tr>\n";
+        << "<tr><th>Test Case<th>Status<th>Checks<th>Passed<th>Failed<th>Score";
+    if (history.HasPrevious()) out << "<th>Since Last Submission";
+    out << "</tr>\n";
 
     for (auto & test_case : tests) {
   //    out << "<tr>" 
@@ -446,12 +1928,16 @@ public:
           << "<td>" << test_case.GetNumChecks()
           << "<td>" << test_case.CountPassed()
           << "<td>" << test_case.CountFailed()
-          << "<td>" << test_case.EarnedPoints() << " / " << test_case.points
-          << "</tr>\n";
+          << "<td>" << test_case.EarnedPoints() << " / " << test_case.points;
+      if (history.HasPrevious()) out << "<td>" << GetTrendString(test_case).AsWebSafe();
+      out << "</tr>\n";
     }
       out << "<tr><th>" << "TOTAL"
-          << "<td><td><td><td><td>" << CountEarnedPoints() << " / " << CountTotalPoints()
-          << "</tr></table>\n";
+          << "<td><td><td><td><td>" << CountEarnedPoints() << " / " << CountTotalPoints();
+      if (history.HasPrevious()) {
+        out << "<td>Score history: " << History::Sparkline(history.GetPercentSeries());
+      }
+      out << "</tr></table>\n";
       if (link_base != "") {
         out << "<p>Click on a row above to jump to the test case";
         if (link_base == "#") out << " or scroll down for more details";
@@ -460,35 +1946,70 @@ public:
       out << "<hr>";
   }
 
-  void PrintSummary() {
-    for (auto & output : outputs) {
-      if (output.HasSummary()) {
-        if (output.IsHTML()) {
-          emp::String link_base = "";
-          if (output.HasLink()) link_base = output.GetLinkFile() + "#";
-          if (output.HasResults()) link_base = "#";
-          PrintSummary_HTML(output.GetFile(), link_base);
-        }
-        else PrintSummary_Text(output.GetFile());
-      }
-      else if (output.HasScore()) {
-        output.GetFile() << CountEarnedPoints() << " of " << CountTotalPoints();
-      }
-      else if (output.HasPercent()) {
-        output.GetFile() << GetPercentEarned() << "%" << std::endl;
+  void PrintSummary(OutputInfo & output) {
+    if (output.HasSummary()) {
+      if (output.IsHTML()) {
+        emp::String link_base = "";
+        if (output.HasLink()) link_base = output.GetLinkFile() + "#";
+        if (output.HasResults()) link_base = "#";
+        PrintSummary_HTML(output.GetFile(), link_base);
       }
+      else PrintSummary_Text(output.GetFile());
+    }
+    else if (output.HasScore()) {
+      output.GetFile() << CountEarnedPoints() << " of " << CountTotalPoints();
+    }
+    else if (output.HasPercent()) {
+      output.GetFile() << GetPercentEarned() << "%" << std::endl;
     }
   }
 
-  void PrintResults() {
-    PrintSummary();
+  // Print all outputs.  If preliminary, only write output files that don't show hidden details
+  // (i.e., student reports) and close them so they can be read while hidden tests still run; they
+  // are rewritten from the start when the final results are printed.
+  void PrintResults(bool preliminary=false) {
+    for (auto & output : outputs) {
+      if (preliminary && (output.GetFilename().empty() || output.HasHiddenDetails())) continue;
+      PrintSummary(output);
+      for (const auto & test : tests) test.PrintResult(output);
+      if (preliminary) output.Reset();
+    }
+  }
 
-    for (const auto & test : tests) {
-      // And print results to the output files...
-      for (auto & output : outputs) {
-        test.PrintResult(output);
-      }
+  bool HasPendingTests() const {
+    return std::any_of(tests.begin(), tests.end(), [](const auto & test){ return test.pending; });
+  }
+
+  size_t CountPendingTests() const {
+    return std::count_if(tests.begin(), tests.end(), [](const auto & test){ return test.pending; });
+  }
+
+  // Run the hidden tests that were put off until visible results were published.  Their compilers
+  // run at a lower priority so they only use spare capacity; the test executables themselves keep
+  // normal priority so that timeouts and performance measurements aren't affected.
+  void RunDeferredTests() {
+    compile_nice = emp::from_string<int>(var_map["defer_nice"]);
+    for (auto & deferred : deferred_tests) {
+      if (job.IsCancelled()) return;
+      Testcase & test = tests[deferred.test_id];
+      std::cout << "Running deferred test case " << test.id << "." << std::endl;
+
+      // Restore the configuration that was active when the testcase was read.
+      auto saved_vars = var_map;
+      auto saved_header = header;
+      auto saved_compile = compile;
+      var_map = deferred.vars;
+      header = deferred.header;
+      compile = deferred.compile;
+      test.pending = false;
+      metrics.Set("emperfect_queue_depth", CountPendingTests());
+      RunTest(test);
+      var_map = saved_vars;
+      header = saved_header;
+      compile = saved_compile;
     }
+    compile_nice = 0;
+    deferred_tests.resize(0);
   }
 
   void PrintDebug(std::ostream & out=std::cout) {
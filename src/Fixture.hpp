@@ -0,0 +1,86 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  Fixture.hpp
+ *  @brief Setup code shared by several testcases, run once in a process they each fork from.
+ *
+ *  All testcases attached to a fixture are compiled into a single executable.  It runs the
+ *  fixture's setup code once and then forks a child for each testcase; children start from the
+ *  set-up state (sharing its memory copy-on-write) but cannot see each other's changes.  The setup
+ *  code is stopped by an alarm if it runs past the fixture's timeout; once it finishes, the fixture
+ *  process writes "SETUP done" to its setup file.  For each testcase, it then writes a status file
+ *  with lines "EXIT <code>", "TIMEOUT <0/1>", "TIME <seconds>", and "MEMORY <bytes>".
+ */
+
+#ifndef EMPERFECT_FIXTURE_HPP
+#define EMPERFECT_FIXTURE_HPP
+
+#include <map>
+#include <ostream>
+
+#include "emp/base/vector.hpp"
+#include "emp/tools/String.hpp"
+
+struct Fixture {
+  emp::String name;                          // Name that testcases use to attach to this fixture.
+  emp::vector<emp::String> code;             // Setup code, run once before any testcase.
+  size_t timeout = 60;                       // Seconds allowed for setup (on top of test timeouts).
+  emp::vector<size_t> test_ids;              // Testcases attached to this fixture, in order.
+
+  std::map<emp::String, emp::String> vars;   // Variables when the fixture was read.
+  emp::vector<emp::String> header;           // Header when the fixture was read.
+  emp::vector<emp::String> compile;          // Compile rules when the fixture was read.
+
+  // Print the helper that the generated fixture code uses to run each testcase in a child.
+  static void PrintForkCPP(std::ostream & cpp_file) {
+    cpp_file
+      << "#include <chrono>\n"
+      << "#include <csignal>\n"
+      << "#include <cstdio>\n"
+      << "#include <fcntl.h>\n"
+      << "#include <sys/resource.h>\n"
+      << "#include <sys/wait.h>\n"
+      << "#include <unistd.h>\n"
+      << "\n"
+      << "// Run a testcase in a child forked from the fixture and record how it finished.\n"
+      << "template <typename FUN_T>\n"
+      << "void _emperfect_fork(FUN_T test_fun, const char * in, const char * out, const char * err,\n"
+      << "                     unsigned int timeout, const char * status) {\n"
+      << "  std::cout.flush(); std::cerr.flush(); std::fflush(nullptr);\n"
+      << "  const auto start = std::chrono::steady_clock::now();\n"
+      << "  const pid_t pid = fork();\n"
+      << "  if (pid == 0) {\n"
+      << "    auto redirect = [](const char * filename, int target, int flags) {\n"
+      << "      if (!filename[0]) return;\n"
+      << "      int fd = open(filename, flags, 0644);\n"
+      << "      if (fd < 0) _exit(127);\n"
+      << "      dup2(fd, target);\n"
+      << "      close(fd);\n"
+      << "    };\n"
+      << "    redirect(in, 0, O_RDONLY);\n"
+      << "    redirect(out, 1, O_WRONLY | O_CREAT | O_TRUNC);\n"
+      << "    redirect(err, 2, O_WRONLY | O_CREAT | O_TRUNC);\n"
+      << "    std::cin.clear();\n"
+      << "    alarm(timeout);\n"
+      << "    test_fun();\n"
+      << "    std::cout.flush(); std::cerr.flush(); std::fflush(nullptr);\n"
+      << "    _exit(0);\n"
+      << "  }\n"
+      << "  int wait_status = 0;\n"
+      << "  rusage usage{};\n"
+      << "  if (pid < 0 || wait4(pid, &wait_status, 0, &usage) < 0) return;\n"
+      << "  const double seconds =\n"
+      << "    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();\n"
+      << "  const bool signaled = WIFSIGNALED(wait_status);\n"
+      << "  std::ofstream status_file(status);\n"
+      << "  status_file << \"EXIT \" << (signaled ? 128 + WTERMSIG(wait_status) : WEXITSTATUS(wait_status)) << \"\\n\"\n"
+      << "              << \"TIMEOUT \" << (signaled && WTERMSIG(wait_status) == SIGALRM) << \"\\n\"\n"
+      << "              << \"TIME \" << seconds << \"\\n\"\n"
+      << "              << \"MEMORY \" << usage.ru_maxrss * 1024L << \"\\n\";\n"
+      << "}\n\n";
+  }
+};
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  FixturePack.hpp
+ *  @brief A single file holding many test inputs and expected outputs, read in place with mmap.
+ *
+ *  Pack format: the line "EMPACK1", then one index line per fixture ("<name>\t<size in bytes>"),
+ *  then a blank line, followed by the contents of every fixture back-to-back in index order.
+ *  Testcases refer to a fixture in the pack as "pack:<name>".
+ */
+
+#ifndef EMPERFECT_FIXTURE_PACK_HPP
+#define EMPERFECT_FIXTURE_PACK_HPP
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class FixturePack {
+private:
+  std::string filename;                              // File the pack was loaded from.
+  const char * data = nullptr;                       // Start of the mapped pack.
+  size_t data_size = 0;                              // Size of the mapped pack.
+  std::map<std::string, std::string_view> fixtures;  // Contents of each fixture, by name.
+
+  static constexpr std::string_view MAGIC = "EMPACK1\n";
+
+public:
+  FixturePack() = default;
+  FixturePack(const FixturePack &) = delete;
+  FixturePack & operator=(const FixturePack &) = delete;
+  ~FixturePack() { Close(); }
+
+  static constexpr std::string_view PREFIX = "pack:";
+
+  // Does a testcase setting refer to a fixture in a pack?
+  static bool IsPacked(std::string_view name) { return name.starts_with(PREFIX); }
+
+  bool IsOpen() const { return data != nullptr; }
+  const std::string & GetFilename() const { return filename; }
+  size_t GetSize() const { return fixtures.size(); }
+  bool Has(std::string_view name) const {
+    if (IsPacked(name)) name.remove_prefix(PREFIX.size());
+    return fixtures.count(std::string(name));
+  }
+
+  // Map a pack file into memory and read its index; return false if it isn't a valid pack.
+  bool Open(const std::string & _filename) {
+    Close();
+    int fd = open(_filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(MAGIC.size())) { close(fd); return false; }
+    void * ptr = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping stays valid after the file is closed.
+    if (ptr == MAP_FAILED) return false;
+    filename = _filename;
+    data = static_cast<const char *>(ptr);
+    data_size = static_cast<size_t>(info.st_size);
+
+    const std::string_view pack(data, data_size);
+    if (!pack.starts_with(MAGIC)) { Close(); return false; }
+
+    // Read the index, then find where each fixture's contents start.
+    std::vector<std::pair<std::string, size_t>> index;
+    size_t pos = MAGIC.size();
+    while (true) {
+      const size_t end = pack.find('\n', pos);
+      if (end == std::string_view::npos) { Close(); return false; }
+      if (end == pos) { ++pos; break; }      // Blank line ends the index.
+      const std::string_view line = pack.substr(pos, end - pos);
+      const size_t tab_pos = line.rfind('\t');
+      if (tab_pos == std::string_view::npos) { Close(); return false; }
+      index.emplace_back(std::string(line.substr(0, tab_pos)),
+                         std::strtoull(std::string(line.substr(tab_pos+1)).c_str(), nullptr, 10));
+      pos = end + 1;
+    }
+    for (const auto & [name, size] : index) {
+      if (pos + size > data_size) { Close(); return false; }
+      fixtures[name] = pack.substr(pos, size);
+      pos += size;
+    }
+    return true;
+  }
+
+  void Close() {
+    if (data) munmap(const_cast<char *>(data), data_size);
+    data = nullptr;
+    data_size = 0;
+    fixtures.clear();
+  }
+
+  // Get the contents of a fixture (with or without the "pack:" prefix); empty if not found.
+  std::string_view Get(std::string_view name) const {
+    if (IsPacked(name)) name.remove_prefix(PREFIX.size());
+    auto it = fixtures.find(std::string(name));
+    return (it == fixtures.end()) ? std::string_view() : it->second;
+  }
+
+  // Create an in-memory file holding a fixture, positioned at its start (to use as standard
+  // input for a child process).  Returns -1 on failure; the caller must close the descriptor.
+  int OpenMemFD(std::string_view name) const {
+    const std::string_view contents = Get(name);
+    int fd = memfd_create("emperfect-fixture", MFD_CLOEXEC);
+    if (fd < 0) return -1;
+    size_t pos = 0;
+    while (pos < contents.size()) {
+      ssize_t count = write(fd, contents.data() + pos, contents.size() - pos);
+      if (count <= 0) { close(fd); return -1; }
+      pos += static_cast<size_t>(count);
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+  }
+
+  // Build a pack from a set of files; each fixture is named by the path given for it.
+  static bool Create(const std::string & pack_filename, const std::vector<std::string> & files) {
+    std::ofstream pack(pack_filename, std::ios::binary);
+    pack << MAGIC;
+    std::vector<std::string> contents;
+    for (const auto & file : files) {
+      if (file.find_first_of("\t\n") != std::string::npos) return false;
+      std::ifstream in(file, std::ios::binary);
+      if (!in) return false;
+      contents.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+      pack << file << '\t' << contents.back().size() << '\n';
+    }
+    pack << '\n';
+    for (const auto & content : contents) pack << content;
+    return static_cast<bool>(pack);
+  }
+};
+
+#endif
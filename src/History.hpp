@@ -0,0 +1,187 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  History.hpp
+ *  @brief Results from a student's previous submissions, to show how performance is changing.
+ *
+ *  The history file has one line per submission ("S <unix time> <percent>") followed by one line
+ *  per testcase ("T <id> <score> <run seconds> <peak memory bytes>").  Only the most recent
+ *  submissions are kept.  Updates take a lock, so concurrent runs for the same student don't lose
+ *  each other's submissions.
+ */
+
+#ifndef EMPERFECT_HISTORY_HPP
+#define EMPERFECT_HISTORY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// Results of a single testcase in one submission.
+struct HistoryEntry {
+  double score = 0.0;      // Points earned.
+  double run_time = 0.0;   // Seconds the executable ran.
+  size_t memory = 0;       // Peak memory (in bytes) of the executable.
+};
+
+// Results of one full submission.
+struct HistorySubmission {
+  long long time = 0;                      // When was this submission graded (unix time)?
+  double percent = 0.0;                    // Final score (as a percentage).
+  std::map<size_t, HistoryEntry> tests;    // Results for each testcase, by ID.
+};
+
+class History {
+private:
+  std::vector<HistorySubmission> submissions;  // Oldest first.
+  size_t max_submissions = 20;                 // How many submissions should we remember?
+
+  // Describe the percent change from an old value to a new one (or "" if too small to matter).
+  static std::string PercentChange(double old_value, double new_value, const std::string & label) {
+    if (old_value <= 0.0) return "";
+    const double change = 100.0 * (new_value - old_value) / old_value;
+    if (std::abs(change) < 1.0) return "";
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%s %+.0f%%", label.c_str(), change);
+    return buffer;
+  }
+
+public:
+  History() = default;
+  History(size_t _max) : max_submissions(_max) { }
+
+  size_t GetSize() const { return submissions.size(); }
+  bool HasPrevious() const { return submissions.size() >= 2; }
+
+  // Load a history file (a missing file is just an empty history).
+  void Load(const std::string & filename) {
+    submissions.clear();
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+      std::stringstream ss(line);
+      std::string type;
+      ss >> type;
+      if (type == "S") {
+        submissions.emplace_back();
+        ss >> submissions.back().time >> submissions.back().percent;
+      } else if (type == "T" && submissions.size()) {
+        size_t id = 0;
+        HistoryEntry entry;
+        if (ss >> id >> entry.score >> entry.run_time >> entry.memory) {
+          submissions.back().tests[id] = entry;
+        }
+      }
+    }
+  }
+
+  // Save the history, replacing the old file all at once so a crash can't leave half of it.
+  bool Save(const std::string & filename) const {
+    const std::string tmp_filename = filename + ".tmp" + std::to_string(getpid());
+    std::ofstream file(tmp_filename);
+    for (const auto & submission : submissions) {
+      file << "S " << submission.time << " " << submission.percent << "\n";
+      for (const auto & [id, entry] : submission.tests) {
+        file << "T " << id << " " << entry.score << " " << entry.run_time << " " << entry.memory << "\n";
+      }
+    }
+    file.close();
+    if (!file) return false;
+    return std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+  }
+
+  // Add the current submission to the end of the history.
+  void Add(HistorySubmission submission) {
+    if (submission.time == 0) submission.time = static_cast<long long>(std::time(nullptr));
+    submissions.push_back(submission);
+    if (submissions.size() > max_submissions) {
+      submissions.erase(submissions.begin(), submissions.end() - max_submissions);
+    }
+  }
+
+  // Add the current submission to a history file, merging with any other runs updating it at the
+  // same time.  Returns false if the file could not be written.
+  bool Update(const std::string & filename, const HistorySubmission & submission) {
+    // Lock out other runs while reading and replacing the file.
+    const int lock_fd = open((filename + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd >= 0) flock(lock_fd, LOCK_EX);
+
+    Load(filename);
+    Add(submission);
+    const bool success = Save(filename);
+
+    if (lock_fd >= 0) { flock(lock_fd, LOCK_UN); close(lock_fd); }
+    return success;
+  }
+
+  // Collect a value across all submissions for a testcase (skipping submissions without it).
+  std::vector<double> GetSeries(size_t test_id, double HistoryEntry::*field) const {
+    std::vector<double> out;
+    for (const auto & submission : submissions) {
+      auto it = submission.tests.find(test_id);
+      if (it != submission.tests.end()) out.push_back(it->second.*field);
+    }
+    return out;
+  }
+
+  std::vector<double> GetPercentSeries() const {
+    std::vector<double> out;
+    for (const auto & submission : submissions) out.push_back(submission.percent);
+    return out;
+  }
+
+  // Describe how a testcase changed since the previous submission (e.g., "time -12%, mem +3%")
+  std::string GetChangeString(size_t test_id) const {
+    if (!HasPrevious()) return "";
+    const auto & prev_tests = submissions[submissions.size()-2].tests;
+    const auto & cur_tests = submissions.back().tests;
+    auto prev_it = prev_tests.find(test_id);
+    auto cur_it = cur_tests.find(test_id);
+    if (prev_it == prev_tests.end() || cur_it == cur_tests.end()) return "";
+    const HistoryEntry & prev = prev_it->second;
+    const HistoryEntry & cur = cur_it->second;
+
+    std::string out;
+    auto add = [&out](const std::string & part) {
+      if (part.empty()) return;
+      if (out.size()) out += ", ";
+      out += part;
+    };
+    if (cur.score != prev.score) {
+      std::stringstream ss;
+      ss << "score " << (cur.score > prev.score ? "+" : "") << (cur.score - prev.score);
+      add(ss.str());
+    }
+    add(PercentChange(prev.run_time, cur.run_time, "time"));
+    add(PercentChange(static_cast<double>(prev.memory), static_cast<double>(cur.memory), "mem"));
+    return out.size() ? out : "no change";
+  }
+
+  // Draw a series of values as a small unicode bar chart, e.g. "▇▆▃▁".
+  static std::string Sparkline(const std::vector<double> & values) {
+    static const char * bars[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+    if (values.empty()) return "";
+    double min = values[0], max = values[0];
+    for (double value : values) { min = std::min(min, value); max = std::max(max, value); }
+    std::string out;
+    for (double value : values) {
+      const size_t level = (max == min) ? 3 : static_cast<size_t>(std::round(7.0 * (value - min) / (max - min)));
+      out += bars[level];
+    }
+    return out;
+  }
+};
+
+#endif
@@ -0,0 +1,137 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  Job.hpp
+ *  @brief Identity of a grading run, so that a newer submission can cancel an older one.
+ *
+ *  Each job (e.g., one student on one assignment) has a file in a shared jobs directory holding
+ *  the host, process ID, and process start time of the run that currently owns it.  A new run
+ *  takes over the file and sends SIGTERM to the old owner, but only if it is on the same host and
+ *  its start time shows the process ID hasn't been reused since.  A run also gives up on its own
+ *  if it finds that the file has been taken over (e.g., by a run on another host sharing the
+ *  directory).  Since only the newest run keeps going, a burst of resubmissions is coalesced into
+ *  grading just the last one.
+ */
+
+#ifndef EMPERFECT_JOB_HPP
+#define EMPERFECT_JOB_HPP
+
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "Process.hpp"
+
+// Which run owns a job.
+struct JobOwner {
+  pid_t pid = -1;                 // Process ID of the run (-1 if none).
+  std::string host;               // Host the run is on.
+  unsigned long long start = 0;   // When the process started (clock ticks since boot).
+
+  bool operator==(const JobOwner & in) const {
+    return pid == in.pid && host == in.host && start == in.start;
+  }
+  bool operator!=(const JobOwner & in) const { return !(*this == in); }
+};
+
+class Job {
+private:
+  std::string filename;      // File that records which run owns this job (empty if no job).
+  JobOwner self;             // Identity of this run.
+  bool cancelled = false;    // Has this run been superseded?
+
+  // Stop any running child right away once we've been told to give up.
+  static void HandleSignal(int) { Process::CancelAll(); }
+
+  static std::string GetHostName() {
+    char buffer[HOST_NAME_MAX + 1] = "";
+    if (gethostname(buffer, sizeof(buffer)) != 0) return "unknown";
+    buffer[HOST_NAME_MAX] = '\0';
+    return buffer;
+  }
+
+  // Find when a process started (field 22 of /proc/<pid>/stat), or 0 if it isn't running.
+  static unsigned long long GetStartTime(pid_t pid) {
+    std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat;
+    if (!std::getline(file, stat)) return 0;
+    // The command name (field 2) may contain spaces, so count fields from its closing paren.
+    const size_t paren_pos = stat.rfind(')');
+    if (paren_pos == std::string::npos) return 0;
+    std::stringstream ss(stat.substr(paren_pos + 1));
+    std::string field;
+    for (size_t i = 3; i < 22; ++i) ss >> field;  // Skip fields 3 through 21.
+    unsigned long long start = 0;
+    ss >> start;
+    return start;
+  }
+
+  // Find which run currently owns the job (pid is -1 if none).
+  JobOwner ReadOwner() const {
+    std::ifstream file(filename);
+    JobOwner owner;
+    long pid = -1;
+    if (!(file >> pid >> owner.host >> owner.start)) return JobOwner{};
+    owner.pid = static_cast<pid_t>(pid);
+    return owner;
+  }
+
+public:
+  bool IsActive() const { return filename.size(); }
+  const std::string & GetFilename() const { return filename; }
+
+  // Take ownership of a job, cancelling any older run of it.  Returns true if a run was cancelled.
+  bool Claim(const std::string & jobs_dir, const std::string & name) {
+    std::filesystem::create_directories(jobs_dir);
+    filename = (std::filesystem::path(jobs_dir) / (name + ".job")).string();
+    self.pid = getpid();
+    self.host = GetHostName();
+    self.start = GetStartTime(self.pid);
+    const JobOwner old_owner = ReadOwner();
+
+    // Write the new owner under a temporary name, then rename it so readers never see a partial file.
+    const std::string tmp_filename = filename + ".tmp" + std::to_string(self.pid);
+    std::ofstream(tmp_filename) << self.pid << " " << self.host << " " << self.start << "\n";
+    std::rename(tmp_filename.c_str(), filename.c_str());
+
+    struct sigaction action{};
+    action.sa_handler = HandleSignal;
+    sigaction(SIGTERM, &action, nullptr);
+
+    // Only signal a process we can be sure is the old run; any other older run (e.g., on another
+    // host) will notice the change of owner on its own.
+    if (old_owner.pid > 0 && old_owner != self && old_owner.host == self.host && self.host != "unknown"
+        && old_owner.start != 0 && GetStartTime(old_owner.pid) == old_owner.start) {
+      kill(old_owner.pid, SIGTERM);
+      return true;
+    }
+    return false;
+  }
+
+  // Has a newer run taken over this job?
+  bool IsCancelled() {
+    if (cancelled || !IsActive()) return cancelled;
+    if (Process::IsCancelled() || ReadOwner() != self) {
+      cancelled = true;
+      Process::CancelAll();
+    }
+    return cancelled;
+  }
+
+  // Give up ownership of the job (if we still have it) when the run is finished.
+  void Release() {
+    if (IsActive() && ReadOwner() == self) std::filesystem::remove(filename);
+    filename.clear();
+  }
+};
+
+#endif
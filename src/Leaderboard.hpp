@@ -0,0 +1,220 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  Leaderboard.hpp
+ *  @brief A class leaderboard ranking submissions by the performance measured while grading.
+ *
+ *  The leaderboard file has one line per participant ("E <unix time> <submissions> <name>")
+ *  followed by one line per metric ("V <metric> <value>") for their best submission so far.
+ *  Any number of grading runs can share a leaderboard: each update takes a lock, merges in the
+ *  new submission, and replaces the file all at once.
+ */
+
+#ifndef EMPERFECT_LEADERBOARD_HPP
+#define EMPERFECT_LEADERBOARD_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "emp/tools/String.hpp"
+
+#include "extras.hpp"
+#include "PerfMetric.hpp"
+
+// One participant's best submission.
+struct LeaderboardEntry {
+  std::string name;                       // Who is this (possibly anonymized)?
+  long long time = 0;                     // When was their best submission graded (unix time)?
+  size_t submissions = 1;                 // How many correct submissions have they made?
+  std::map<std::string, double> values;   // Measured value of each metric, by name.
+};
+
+class Leaderboard {
+private:
+  std::string filename;                   // File where the leaderboard is kept.
+  std::string participant;                // Name this run submits under.
+  std::string html_filename;              // Page to render the leaderboard to (if any).
+  std::string title = "Leaderboard";      // Heading for the rendered page.
+  std::vector<std::string> metric_names;  // Metrics to show (empty for all that were measured).
+  std::string rank_by;                    // Metric used to order entries (default: first shown).
+  bool anonymize = false;                 // Should names be replaced by a hash?
+  std::string salt;                       // Extra text mixed into hashes so names can't be guessed.
+  size_t top = 0;                         // Number of entries to render (0 for all).
+
+  std::vector<LeaderboardEntry> entries;  // Best first.
+
+  // Is entry a ranked ahead of entry b?
+  bool IsBetter(const LeaderboardEntry & a, const LeaderboardEntry & b) const {
+    const std::string metric = GetRankMetric();
+    auto a_it = a.values.find(metric), b_it = b.values.find(metric);
+    if (a_it == a.values.end() || b_it == b.values.end()) return b_it == b.values.end() && a_it != a.values.end();
+    if (a_it->second == b_it->second) return a.time < b.time;  // Ties go to the earlier submission.
+    const bool higher_better = PerfMetric::GetType(metric).higher_better;
+    return higher_better ? a_it->second > b_it->second : a_it->second < b_it->second;
+  }
+
+  void Read() {
+    entries.clear();
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+      std::stringstream ss(line);
+      std::string type;
+      ss >> type;
+      if (type == "E") {
+        entries.emplace_back();
+        ss >> entries.back().time >> entries.back().submissions >> std::ws;
+        std::getline(ss, entries.back().name);
+      } else if (type == "V" && entries.size()) {
+        std::string metric;
+        double value = 0.0;
+        if (ss >> metric >> value) entries.back().values[metric] = value;
+      }
+    }
+  }
+
+  bool Save() const {
+    const std::string tmp_filename = filename + ".tmp" + std::to_string(getpid());
+    std::ofstream file(tmp_filename);
+    file << std::setprecision(15);
+    for (const auto & entry : entries) {
+      file << "E " << entry.time << " " << entry.submissions << " " << entry.name << "\n";
+      for (const auto & [metric, value] : entry.values) file << "V " << metric << " " << value << "\n";
+    }
+    file.close();
+    if (!file) return false;
+    return std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+  }
+
+public:
+  Leaderboard() = default;
+  Leaderboard(const std::string & _filename) : filename(_filename) { }
+
+  const std::string & GetFilename() const { return filename; }
+  const std::string & GetParticipant() const { return participant; }
+  const std::string & GetHTMLFilename() const { return html_filename; }
+  const std::vector<std::string> & GetMetricNames() const { return metric_names; }
+  std::string GetRankMetric() const {
+    if (rank_by.size()) return rank_by;
+    return metric_names.size() ? metric_names[0] : "run_time";
+  }
+  size_t GetSize() const { return entries.size(); }
+
+  void SetFile(const std::string & _in) { filename = _in; }
+  void SetParticipant(const std::string & _in) { participant = _in; }
+  void SetHTMLFile(const std::string & _in) { html_filename = _in; }
+  void SetTitle(const std::string & _in) { title = _in; }
+  void SetMetrics(const std::vector<std::string> & _in) { metric_names = _in; }
+  void SetRankBy(const std::string & _in) { rank_by = _in; }
+  void SetAnonymize(bool _in, const std::string & _salt="") { anonymize = _in; salt = _salt; }
+  void SetTop(size_t _in) { top = _in; }
+
+  // Determine the name shown for a participant (a short hash if anonymized).
+  std::string GetDisplayName(const std::string & name) const {
+    if (!anonymize) return name;
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "anon-%08llx",
+                  static_cast<unsigned long long>(HashFNV1a(name, HashFNV1a(salt)) & 0xffffffffULL));
+    return buffer;
+  }
+
+  // Merge a new submission in, keeping each participant's best; returns false if the leaderboard
+  // could not be updated.
+  bool Submit(LeaderboardEntry submission) {
+    if (submission.time == 0) submission.time = static_cast<long long>(std::time(nullptr));
+    submission.name = GetDisplayName(submission.name);
+    if (metric_names.size()) {  // Only keep the metrics being compared.
+      std::map<std::string, double> values;
+      for (const auto & metric : metric_names) {
+        auto it = submission.values.find(metric);
+        if (it != submission.values.end()) values[metric] = it->second;
+      }
+      submission.values = values;
+    }
+
+    // Lock out other runs while reading and replacing the file.
+    const int lock_fd = open((filename + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd >= 0) flock(lock_fd, LOCK_EX);
+
+    Read();
+    auto it = std::find_if(entries.begin(), entries.end(),
+                           [&submission](const auto & entry){ return entry.name == submission.name; });
+    if (it == entries.end()) entries.push_back(submission);
+    else {
+      submission.submissions = it->submissions + 1;
+      it->submissions = submission.submissions;
+      if (IsBetter(submission, *it)) *it = submission;
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [this](const auto & a, const auto & b){ return IsBetter(a, b); });
+    bool success = Save();
+
+    // Render the page while still holding the lock, so an older version can't replace it.
+    if (success && html_filename.size()) {
+      const std::string tmp_filename = html_filename + ".tmp" + std::to_string(getpid());
+      std::ofstream html_file(tmp_filename);
+      PrintHTML(html_file);
+      html_file.close();
+      success = html_file && std::rename(tmp_filename.c_str(), html_filename.c_str()) == 0;
+    }
+
+    if (lock_fd >= 0) { flock(lock_fd, LOCK_UN); close(lock_fd); }
+    return success;
+  }
+
+  // Render the leaderboard as a small HTML page.
+  void PrintHTML(std::ostream & out) const {
+    // Show the requested metrics, or every metric any entry has.
+    std::vector<std::string> columns = metric_names;
+    if (columns.empty()) {
+      columns.push_back(GetRankMetric());
+      for (const auto & entry : entries) {
+        for (const auto & [metric, value] : entry.values) {
+          if (std::find(columns.begin(), columns.end(), metric) == columns.end()) columns.push_back(metric);
+        }
+      }
+    }
+
+    out << "<!DOCTYPE html>\n<html>\n<head><meta charset=\"utf-8\"><title>"
+        << emp::String(title).AsWebSafe() << "</title></head>\n<body>\n"
+        << "<h1>" << emp::String(title).AsWebSafe() << "</h1>\n"
+        << "<p>Ranked by " << PerfMetric::GetType(GetRankMetric()).desc
+        << (PerfMetric::GetType(GetRankMetric()).higher_better ? " (higher is better)" : " (lower is better)")
+        << ", as measured by the grader.</p>\n"
+        << "<table style=\"background-color:#E3E0CF;\">\n<tr><th>Rank<th>Name";
+    for (const auto & metric : columns) out << "<th>" << metric;
+    out << "<th>Submissions<th>Last Improved</tr>\n";
+
+    const size_t count = (top && top < entries.size()) ? top : entries.size();
+    for (size_t i = 0; i < count; ++i) {
+      const auto & entry = entries[i];
+      out << "<tr><td>" << (i+1) << "<td>" << emp::String(entry.name).AsWebSafe();
+      for (const auto & metric : columns) {
+        auto it = entry.values.find(metric);
+        out << "<td>";
+        if (it != entry.values.end()) out << PerfMetric::FormatValue(it->second, PerfMetric::GetType(metric).unit);
+      }
+      char date[32] = "";
+      const std::time_t time = static_cast<std::time_t>(entry.time);
+      std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M", std::localtime(&time));
+      out << "<td>" << entry.submissions << "<td>" << date << "</tr>\n";
+    }
+    out << "</table>\n</body>\n</html>\n";
+  }
+};
+
+#endif
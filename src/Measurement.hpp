@@ -0,0 +1,115 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  Measurement.hpp
+ *  @brief Collect repeated performance samples until they are stable enough to grade.
+ *
+ *  After some warm-up runs are discarded, samples are collected until the 95% confidence interval
+ *  around the median of every metric is within a target fraction of that median (or a maximum
+ *  number of runs is reached).  Outliers are removed with Tukey's fences before summarizing.
+ */
+
+#ifndef EMPERFECT_MEASUREMENT_HPP
+#define EMPERFECT_MEASUREMENT_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+// Summary of all of the samples collected for a single metric.
+struct MeasureSummary {
+  double median = 0.0;    // Median of samples (after outliers are removed)
+  double low = 0.0;       // Lower bound of 95% confidence interval for the median.
+  double high = 0.0;      // Upper bound of 95% confidence interval for the median.
+  size_t count = 0;       // Number of samples used.
+  size_t outliers = 0;    // Number of samples rejected as outliers.
+
+  // How wide is the confidence interval, relative to the median?
+  double GetRelativeWidth() const {
+    if (median == 0.0) return (high == low) ? 0.0 : INFINITY;
+    return (high - low) / (2.0 * std::abs(median));
+  }
+};
+
+class Measurement {
+private:
+  size_t warmup = 1;         // Number of initial runs to discard.
+  size_t min_runs = 5;       // Minimum number of measured runs.
+  size_t max_runs = 20;      // Maximum number of measured runs.
+  double target_ci = 0.05;   // Target half-width of confidence interval, relative to median.
+
+  size_t num_runs = 0;       // Total runs so far (including warm-up)
+  std::map<std::string, std::vector<double>> samples;  // Measured samples, by metric name.
+
+  // Remove values outside of Tukey's fences (1.5 times the inter-quartile range).
+  static size_t RemoveOutliers(std::vector<double> & values) {
+    if (values.size() < 4) return 0;
+    std::sort(values.begin(), values.end());
+    const double q1 = values[values.size() / 4];
+    const double q3 = values[(values.size() * 3) / 4];
+    const double fence = 1.5 * (q3 - q1);
+    const size_t start_size = values.size();
+    std::erase_if(values, [=](double x){ return x < q1 - fence || x > q3 + fence; });
+    return start_size - values.size();
+  }
+
+public:
+  Measurement() = default;
+  Measurement(size_t _warmup, size_t _min, size_t _max, double _ci)
+    : warmup(_warmup), min_runs(_min), max_runs(std::max(_min, _max)), target_ci(_ci) { }
+
+  size_t GetNumRuns() const { return num_runs; }
+  size_t GetNumSamples() const { return num_runs > warmup ? num_runs - warmup : 0; }
+
+  // Record the results of one run (ignored if still warming up).
+  void AddSample(const std::map<std::string, double> & values) {
+    ++num_runs;
+    if (num_runs <= warmup) return;
+    for (const auto & [name, value] : values) samples[name].push_back(value);
+  }
+
+  // Find the median and its 95% confidence interval (using order statistics) for a metric.
+  MeasureSummary Summarize(const std::string & name) const {
+    MeasureSummary summary;
+    auto it = samples.find(name);
+    if (it == samples.end() || it->second.empty()) return summary;
+
+    std::vector<double> values = it->second;
+    summary.outliers = RemoveOutliers(values);
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    summary.count = n;
+    summary.median = (n % 2) ? values[n/2] : (values[n/2 - 1] + values[n/2]) / 2.0;
+
+    // Ranks bounding the median with ~95% confidence (normal approximation to the binomial).
+    const double spread = 1.96 * std::sqrt(static_cast<double>(n)) / 2.0;
+    const double low_rank = std::floor(n / 2.0 - spread);
+    const double high_rank = std::ceil(n / 2.0 + spread);
+    summary.low = values[static_cast<size_t>(std::max(low_rank, 1.0)) - 1];
+    summary.high = values[std::min(static_cast<size_t>(std::max(high_rank, 1.0)), n) - 1];
+    return summary;
+  }
+
+  // Are the confidence intervals for all metrics tight enough?
+  bool IsConverged() const {
+    if (GetNumSamples() < min_runs) return false;
+    for (const auto & [name, values] : samples) {
+      if (Summarize(name).GetRelativeWidth() > target_ci) return false;
+    }
+    return true;
+  }
+
+  // Should another run be performed?
+  bool NeedsMore() const {
+    if (GetNumSamples() < min_runs) return true;
+    return !IsConverged() && GetNumSamples() < max_runs;
+  }
+
+  const std::map<std::string, std::vector<double>> & GetSamples() const { return samples; }
+};
+
+#endif
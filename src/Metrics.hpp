@@ -0,0 +1,226 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  Metrics.hpp
+ *  @brief Grader health metrics, written as a Prometheus-style text file for node monitoring.
+ *
+ *  Counters and histograms are kept as changes since the last write.  Each write locks the file,
+ *  adds those changes to the values already there, and replaces the file all at once, so any
+ *  number of Emperfect runs on a node can share one metrics file.  Gauges that describe a single
+ *  run (e.g., its queue depth) are written as absolute values labelled with the run's pid; series
+ *  for runs that are no longer alive are dropped, so a run that crashes can't skew them for good.
+ */
+
+#ifndef EMPERFECT_METRICS_HPP
+#define EMPERFECT_METRICS_HPP
+
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+class Metrics {
+private:
+  // A group of related series in the output (e.g., all of the buckets of a histogram).
+  struct Family {
+    std::string name;
+    std::string type;                 // "counter", "gauge", or "histogram"
+    std::string help;
+    bool per_run = false;             // Is there a separate series for each run (by pid)?
+    std::vector<double> buckets = {}; // Upper bounds of histogram buckets.
+  };
+
+  std::string filename;                    // Where should metrics be written? (empty for nowhere)
+  std::vector<Family> families;            // Every kind of metric, in output order.
+  std::map<std::string, double> changes;   // Change to each series since the last write.
+  std::map<std::string, double> gauges;    // Current value of each of this run's gauges.
+  double tests_per_second = 0.0;           // This run's decaying average rate of testcases graded.
+  double rate_time = Now();                // When the rate was last updated (unix time).
+
+  static std::string FormatNumber(double value) {
+    if (std::isinf(value)) return value > 0 ? "+Inf" : "-Inf";
+    std::ostringstream ss;
+    ss << std::setprecision(15) << value;
+    return ss.str();
+  }
+
+  static double Now() {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+
+  // Label a series with the pid of the run it belongs to, e.g. "emperfect_queue_depth{pid="12"}".
+  static std::string RunSeries(const std::string & series, pid_t pid) {
+    const std::string label = "pid=\"" + std::to_string(pid) + "\"";
+    if (series.size() && series.back() == '}') return series.substr(0, series.size() - 1) + "," + label + "}";
+    return series + "{" + label + "}";
+  }
+
+  // Find which run a series belongs to (or -1 if it is shared by all runs).
+  static pid_t GetSeriesPid(const std::string & series) {
+    const size_t label_pos = series.find("pid=\"");
+    if (label_pos == std::string::npos) return -1;
+    return static_cast<pid_t>(std::strtol(series.c_str() + label_pos + 5, nullptr, 10));
+  }
+
+  static bool IsAlive(pid_t pid) { return kill(pid, 0) == 0 || errno == EPERM; }
+
+  static std::string BucketSeries(const std::string & name, double bound) {
+    return name + "_bucket{le=\"" + FormatNumber(bound) + "\"}";
+  }
+
+  // Load all of the series values currently in a metrics file.
+  static std::map<std::string, double> ReadValues(const std::string & filename) {
+    std::map<std::string, double> values;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      const size_t space_pos = line.rfind(' ');
+      if (space_pos == std::string::npos) continue;
+      values[line.substr(0, space_pos)] = std::strtod(line.c_str() + space_pos + 1, nullptr);
+    }
+    return values;
+  }
+
+  const Family * FindFamily(const std::string & name) const {
+    for (const auto & family : families) if (family.name == name) return &family;
+    return nullptr;
+  }
+
+public:
+  Metrics() {
+    const std::vector<double> compile_buckets = { 0.5, 1, 2, 5, 10, 20, 30, 60, 120 };
+    const std::vector<double> run_buckets = { 0.01, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30 };
+    families = {
+      { "emperfect_runs_total", "counter", "Grading runs finished, by result." },
+      { "emperfect_tests_total", "counter", "Testcases graded, by result." },
+      { "emperfect_tests_per_second", "gauge", "Testcases graded per second by each run (one-minute moving average).", true },
+      { "emperfect_queue_depth", "gauge", "Testcases each run has read but not yet run (deferred or attached to a fixture).", true },
+      { "emperfect_compile_seconds", "histogram", "Time to compile each testcase.", false, compile_buckets },
+      { "emperfect_run_seconds", "histogram", "Time to run each testcase executable.", false, run_buckets },
+      { "emperfect_shared_cache_requests_total", "counter", "Lookups of shared objects in the cache, by result." },
+      { "emperfect_shared_cache_hit_ratio", "gauge", "Fraction of shared object lookups found in the cache." },
+      { "emperfect_timeouts_total", "counter", "Processes stopped for running too long, by phase." },
+      { "emperfect_memory_limit_kills_total", "counter", "Processes stopped for using too much memory, by phase." },
+      { "emperfect_last_write_timestamp_seconds", "gauge", "When these metrics were last written (unix time)." },
+    };
+  }
+
+  bool IsActive() const { return filename.size(); }
+  void SetFile(const std::string & _filename) { filename = _filename; }
+
+  // Change a counter series, e.g. Add("emperfect_timeouts_total{phase=\"run\"}").
+  void Add(const std::string & series, double amount=1.0) { changes[series] += amount; }
+
+  // Set the current value of one of this run's gauges, e.g. Set("emperfect_queue_depth", 3).
+  void Set(const std::string & series, double value) { gauges[series] = value; }
+
+  // Record a value in a histogram.
+  void Observe(const std::string & name, double value) {
+    const Family * family = FindFamily(name);
+    if (!family) return;
+    for (double bound : family->buckets) {
+      if (value <= bound) changes[BucketSeries(name, bound)] += 1.0;
+    }
+    changes[BucketSeries(name, INFINITY)] += 1.0;
+    changes[name + "_sum"] += value;
+    changes[name + "_count"] += 1.0;
+  }
+
+  // Merge the changes so far into the metrics file.  On a run's final write (is_final), its gauges
+  // are removed rather than updated.  Returns false if the file could not be written.
+  bool Write(bool is_final=false) {
+    if (!IsActive()) return true;
+
+    // Update this run's decaying average of the test rate (like a load average), even if no
+    // testcases have finished since the last write.
+    const double now = Now();
+    double tests = 0.0;
+    for (const auto & [series, amount] : changes) {
+      if (series.starts_with("emperfect_tests_total")) tests += amount;
+    }
+    if (now > rate_time) {
+      const double decay = std::exp(-(now - rate_time) / 60.0);
+      tests_per_second = tests_per_second * decay + (tests / (now - rate_time)) * (1.0 - decay);
+      rate_time = now;
+    }
+    gauges["emperfect_tests_per_second"] = tests_per_second;
+
+    // Lock out other runs while reading and replacing the file.
+    const int lock_fd = open((filename + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd >= 0) flock(lock_fd, LOCK_EX);
+
+    std::map<std::string, double> values = ReadValues(filename);
+    for (const auto & [series, amount] : changes) values[series] += amount;
+
+    // Replace this run's gauges, and drop those of runs that have ended without removing theirs
+    // (along with any placeholder written when no run had a value).
+    const pid_t pid = getpid();
+    std::erase_if(values, [this, pid](const auto & entry){
+      const pid_t series_pid = GetSeriesPid(entry.first);
+      if (series_pid < 0) {
+        const Family * family = FindFamily(entry.first.substr(0, entry.first.find('{')));
+        return family && family->per_run;
+      }
+      return series_pid == pid || !IsAlive(series_pid);
+    });
+    if (!is_final) {
+      for (const auto & [series, value] : gauges) values[RunSeries(series, pid)] = value;
+    }
+
+    // Update shared gauges.
+    values["emperfect_last_write_timestamp_seconds"] = now;
+    const double hits = values["emperfect_shared_cache_requests_total{result=\"hit\"}"];
+    const double misses = values["emperfect_shared_cache_requests_total{result=\"miss\"}"];
+    if (hits + misses > 0.0) values["emperfect_shared_cache_hit_ratio"] = hits / (hits + misses);
+
+    // Write the new file under a temporary name, then move it into place.
+    const std::string tmp_filename = filename + ".tmp" + std::to_string(getpid());
+    std::ofstream file(tmp_filename);
+    for (const auto & family : families) {
+      file << "# HELP " << family.name << " " << family.help << "\n"
+           << "# TYPE " << family.name << " " << family.type << "\n";
+      if (family.type == "histogram") {
+        for (double bound : family.buckets) {
+          const std::string series = BucketSeries(family.name, bound);
+          file << series << " " << FormatNumber(values[series]) << "\n";
+        }
+        const std::string inf_series = BucketSeries(family.name, INFINITY);
+        file << inf_series << " " << FormatNumber(values[inf_series]) << "\n"
+             << family.name << "_sum " << FormatNumber(values[family.name + "_sum"]) << "\n"
+             << family.name << "_count " << FormatNumber(values[family.name + "_count"]) << "\n";
+        continue;
+      }
+      bool found = false;
+      for (const auto & [series, value] : values) {
+        if (series == family.name || series.starts_with(family.name + "{")) {
+          file << series << " " << FormatNumber(value) << "\n";
+          found = true;
+        }
+      }
+      if (!found) file << family.name << " 0\n";
+    }
+    file.close();
+    const bool success = file && std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+
+    if (lock_fd >= 0) { flock(lock_fd, LOCK_UN); close(lock_fd); }
+    if (success) changes.clear();
+    return success;
+  }
+};
+
+#endif
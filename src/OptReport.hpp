@@ -0,0 +1,221 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  OptReport.hpp
+ *  @brief Parse a compiler optimization report to see which functions were vectorized or inlined.
+ *
+ *  Reports are expected to have one remark per line in the form "file:line:col: kind: message",
+ *  as produced by GCC's -fopt-info (kind is "optimized", "missed", or "note") or by Clang's
+ *  -Rpass options (kind is "remark").  Remarks are matched to the function they occur in by
+ *  scanning the named source file for function bodies.
+ */
+
+#ifndef EMPERFECT_OPT_REPORT_HPP
+#define EMPERFECT_OPT_REPORT_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A single remark from the compiler.
+struct OptRemark {
+  std::string filename;
+  size_t line = 0;
+  std::string kind;      // "optimized", "missed", "note", or "remark"
+  std::string message;
+  std::string function;  // Name of function remark is in (if known)
+};
+
+class OptReport {
+private:
+  std::vector<OptRemark> remarks;
+  std::map<std::string, std::vector<std::string>> line_functions; // Function name for each line.
+
+  // Strip any namespace or class qualifiers from a function name.
+  static std::string BaseName(const std::string & name) {
+    const size_t pos = name.rfind("::");
+    return (pos == std::string::npos) ? name : name.substr(pos+2);
+  }
+
+  static bool IsIdChar(char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; }
+
+  // Does the text contain the function name as a whole word?
+  static bool HasWord(const std::string & text, const std::string & word) {
+    for (size_t pos = text.find(word); pos != std::string::npos; pos = text.find(word, pos+1)) {
+      const size_t end = pos + word.size();
+      if ((pos == 0 || !IsIdChar(text[pos-1])) && (end == text.size() || !IsIdChar(text[end]))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Scan a source file to find which function (if any) each line is inside of.
+  const std::vector<std::string> & GetLineFunctions(const std::string & filename) {
+    auto it = line_functions.find(filename);
+    if (it != line_functions.end()) return it->second;
+
+    std::vector<std::string> & result = line_functions[filename];
+    std::ifstream file(filename);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    const std::string code = ss.str();
+
+    std::vector<std::string> brace_stack;  // Function name (or "") for each open brace.
+    std::string current;                   // Innermost enclosing function.
+    std::string statement;                 // Code since last ';', '{', or '}'.
+    std::string line_function;             // Function found on the current line.
+    result.push_back("");                  // Line numbers start at 1.
+    for (size_t i = 0; i < code.size(); ++i) {
+      const char c = code[i];
+      if (current.size()) line_function = current;
+      if (c == '\n') {
+        result.push_back(line_function);
+        line_function = current;
+        statement += ' ';
+        continue;
+      }
+
+      // Skip comments, strings, and character literals (keeping track of line numbers).
+      if (c == '/' && i+1 < code.size() && (code[i+1] == '/' || code[i+1] == '*')) {
+        const std::string end_marker = (code[i+1] == '/') ? "\n" : "*/";
+        const size_t end = code.find(end_marker, i+2);
+        const size_t stop = (end == std::string::npos) ? code.size() : end;
+        for (size_t j = i; j < stop; ++j) if (code[j] == '\n') result.push_back(current);
+        i = (end_marker == "\n") ? stop - 1 : stop + 1;
+        continue;
+      }
+      if (c == '"' || c == '\'') {
+        size_t j = i + 1;
+        while (j < code.size() && code[j] != c) { if (code[j] == '\\') ++j; ++j; }
+        i = j;
+        continue;
+      }
+
+      if (c == '{') {
+        // A function body starts with an identifier and parameter list (but not a control
+        // statement); once inside of a function, any inner braces belong to it.
+        std::string name;
+        const size_t open_pos = statement.find('(');
+        if (current.empty() && open_pos != std::string::npos && statement.find(')') != std::string::npos) {
+          size_t end = open_pos;
+          while (end > 0 && statement[end-1] == ' ') --end;
+          size_t start = end;
+          while (start > 0 && (IsIdChar(statement[start-1]) || statement[start-1] == ':' || statement[start-1] == '~')) --start;
+          name = statement.substr(start, end - start);
+          if (name == "if" || name == "for" || name == "while" || name == "switch" || name == "catch") name = "";
+        }
+        brace_stack.push_back(name);
+        if (current.empty()) current = BaseName(name);
+        statement.clear();
+      }
+      else if (c == '}') {
+        if (brace_stack.size()) {
+          if (brace_stack.back().size() && BaseName(brace_stack.back()) == current) current.clear();
+          brace_stack.pop_back();
+        }
+        statement.clear();
+      }
+      else if (c == ';') statement.clear();
+      else statement += c;
+    }
+    result.push_back(line_function);
+    return result;
+  }
+
+public:
+  // Load all of the remarks from a report file.
+  void Load(const std::string & report_filename) {
+    std::ifstream file(report_filename);
+    std::string line;
+    while (std::getline(file, line)) {
+      // Find "file:line:col: kind: message"
+      const size_t pos1 = line.find(':');
+      if (pos1 == std::string::npos) continue;
+      const size_t pos2 = line.find(':', pos1+1);
+      const size_t pos3 = (pos2 == std::string::npos) ? pos2 : line.find(':', pos2+1);
+      const size_t pos4 = (pos3 == std::string::npos) ? pos3 : line.find(':', pos3+1);
+      if (pos4 == std::string::npos) continue;
+
+      OptRemark remark;
+      remark.filename = line.substr(0, pos1);
+      remark.line = std::strtoul(line.c_str() + pos1 + 1, nullptr, 10);
+      remark.kind = line.substr(pos3+2, pos4-pos3-2);
+      remark.message = line.substr(pos4+1);
+      while (remark.message.size() && remark.message[0] == ' ') remark.message.erase(0,1);
+      if (remark.line == 0) continue;
+
+      const auto & functions = GetLineFunctions(remark.filename);
+      if (remark.line < functions.size()) remark.function = functions[remark.line];
+      remarks.push_back(remark);
+    }
+  }
+
+  size_t GetNumRemarks() const { return remarks.size(); }
+
+  // Was a loop inside the named function vectorized?
+  bool IsVectorized(const std::string & function) const {
+    const std::string base = BaseName(function);
+    for (const auto & remark : remarks) {
+      if (remark.function != base) continue;
+      if (remark.kind == "optimized" && remark.message.find("loop vectorized") != std::string::npos) return true;
+      if (remark.kind == "remark" && remark.message.find("vectorized loop") != std::string::npos) return true;
+    }
+    return false;
+  }
+
+  // Was the named function inlined into any caller?
+  bool IsInlined(const std::string & function) const {
+    const std::string base = BaseName(function);
+    for (const auto & remark : remarks) {
+      // GCC: "Inlining int Square(int)/12 into int main()/15."
+      if (remark.kind == "optimized" && remark.message.starts_with("Inlining ")) {
+        const size_t into_pos = remark.message.find(" into ");
+        if (HasWord(remark.message.substr(0, into_pos), base)) return true;
+      }
+      // Clang: "'Square' inlined into 'main' ..."
+      if (remark.kind == "remark" && remark.message.starts_with("'" + base + "' inlined into")) return true;
+    }
+    return false;
+  }
+
+  // Collect the reasons the compiler gave for missing vectorization in a function.
+  std::vector<std::string> GetMissedVectorization(const std::string & function) const {
+    const std::string base = BaseName(function);
+    std::vector<std::string> reasons;
+    for (const auto & remark : remarks) {
+      if (remark.function != base) continue;
+      const bool missed = remark.kind == "missed"
+        || (remark.kind == "remark" && remark.message.find("not vectorized") != std::string::npos);
+      if (!missed || remark.message.find("vectoriz") == std::string::npos) continue;
+      const std::string reason = "line " + std::to_string(remark.line) + ": " + remark.message;
+      if (std::find(reasons.begin(), reasons.end(), reason) == reasons.end()) reasons.push_back(reason);
+    }
+    return reasons;
+  }
+
+  // Collect the reasons the compiler gave for not inlining a function.
+  std::vector<std::string> GetMissedInlining(const std::string & function) const {
+    const std::string base = BaseName(function);
+    std::vector<std::string> reasons;
+    for (const auto & remark : remarks) {
+      const bool missed = remark.kind == "missed"
+        || (remark.kind == "remark" && remark.message.find("not inlined") != std::string::npos);
+      if (!missed || !HasWord(remark.message, base)) continue;
+      if (remark.message.find("inlin") == std::string::npos) continue;
+      if (std::find(reasons.begin(), reasons.end(), remark.message) == reasons.end()) {
+        reasons.push_back(remark.message);
+      }
+    }
+    return reasons;
+  }
+};
+
+#endif
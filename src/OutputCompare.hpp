@@ -0,0 +1,94 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  OutputCompare.hpp
+ *  @brief Compare program output against expected output, one line at a time.
+ *
+ *  Both streams are read in step and the comparison stops at the first difference, so large
+ *  outputs never need to be held in memory.  Empty lines are always ignored; case and whitespace
+ *  can be ignored as well (lines left empty once whitespace is removed are then ignored too).
+ */
+
+#ifndef EMPERFECT_OUTPUT_COMPARE_HPP
+#define EMPERFECT_OUTPUT_COMPARE_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <istream>
+#include <sstream>
+#include <string>
+
+// Where (if anywhere) an output first differs from what was expected.
+struct CompareResult {
+  bool match = true;
+  size_t expect_line = 0;    // Line number of the first difference in the expected output.
+  size_t actual_line = 0;    // Line number of the first difference in the actual output.
+  bool expect_end = false;   // Did the expected output end before the difference?
+  bool actual_end = false;   // Did the actual output end before the difference?
+  std::string expect_text;   // Expected line at the difference (after normalization).
+  std::string actual_text;   // Actual line at the difference (after normalization).
+
+  // Describe the first difference, e.g. "line 12: expected "5 apples" but found "5 apple"".
+  std::string Describe() const {
+    if (match) return "matches";
+    std::stringstream ss;
+    if (actual_end) ss << "output ended at line " << actual_line << " but expected \"" << expect_text << "\"";
+    else if (expect_end) ss << "line " << actual_line << ": expected end of output but found \"" << actual_text << "\"";
+    else {
+      ss << "line " << actual_line;
+      if (expect_line != actual_line) ss << " (expected line " << expect_line << ")";
+      ss << ": expected \"" << expect_text << "\" but found \"" << actual_text << "\"";
+    }
+    return ss.str();
+  }
+};
+
+class OutputCompare {
+private:
+  bool match_case = true;    // Does case need to match?
+  bool match_space = true;   // Does whitespace (within lines) need to match?
+
+  // Read the next non-empty line (normalized), tracking line numbers; return false at the end.
+  bool NextLine(std::istream & in, std::string & line, size_t & line_num) const {
+    while (std::getline(in, line)) {
+      ++line_num;
+      if (!match_space) {
+        line.erase(std::remove_if(line.begin(), line.end(),
+                                  [](unsigned char c){ return std::isspace(c); }), line.end());
+      }
+      if (line.empty()) continue;
+      if (!match_case) {
+        std::transform(line.begin(), line.end(), line.begin(),
+                       [](unsigned char c){ return static_cast<char>(std::tolower(c)); });
+      }
+      return true;
+    }
+    return false;
+  }
+
+public:
+  OutputCompare(bool _match_case=true, bool _match_space=true)
+    : match_case(_match_case), match_space(_match_space) { }
+
+  // Compare two streams, stopping at the first difference.
+  CompareResult Compare(std::istream & expect, std::istream & actual) const {
+    CompareResult result;
+    std::string expect_text, actual_text;
+    while (true) {
+      const bool expect_more = NextLine(expect, expect_text, result.expect_line);
+      const bool actual_more = NextLine(actual, actual_text, result.actual_line);
+      if (!expect_more && !actual_more) return result;
+      if (expect_more && actual_more && expect_text == actual_text) continue;
+      result.match = false;
+      result.expect_end = !expect_more;
+      result.actual_end = !actual_more;
+      if (expect_more) result.expect_text = expect_text;
+      if (actual_more) result.actual_text = actual_text;
+      return result;
+    }
+  }
+};
+
+#endif
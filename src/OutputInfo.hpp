@@ -99,6 +99,12 @@ public:
     }
   }
 
+  // Close an output file so that it can be read now and rewritten (from the start) later.
+  void Reset() {
+    if (filename.size() && file_ptr) file_ptr.Delete();
+    file_ptr = nullptr;
+  }
+
   void SetFilename(const std::string & _in) {
     emp::notify::TestError(file_ptr, "Cannot change filename once output file is used. (new name=", _in, ")");
     filename = _in;
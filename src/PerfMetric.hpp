@@ -0,0 +1,291 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  PerfMetric.hpp
+ *  @brief A measured performance value for a testcase, along with any targets used to grade it.
+ *
+ *  Each metric can have a "full" target (full credit at or better than this value) and a "zero"
+ *  target (no credit at or worse than this value); credit is interpolated linearly in between.
+ *  If only one target is provided, it is used as a hard pass/fail threshold.  Targets ending in
+ *  "x" (e.g., "1.5x") are relative to the value measured for a reference solution.
+ */
+
+#ifndef EMPERFECT_PERF_METRIC_HPP
+#define EMPERFECT_PERF_METRIC_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "OutputInfo.hpp"
+
+enum class PerfUnit {
+  COUNT = 0,  // A plain number.
+  SECONDS,    // A time; settings may use ns, us, ms, or s suffixes.
+  BYTES,      // A size; settings may use B, KB, MB, or GB suffixes.
+  RATE        // An amount per second; settings may use K, M, or G suffixes.
+};
+
+// Description of a metric that testcases can measure and grade.
+struct PerfMetricType {
+  PerfUnit unit = PerfUnit::COUNT;
+  bool higher_better = false;  // Are larger values better (e.g., throughput)?
+  std::string desc;            // Human-readable description.
+  bool build = false;          // Is this measured while compiling (rather than by running)?
+};
+
+class PerfMetric {
+private:
+  std::string name;          // Name used for settings (e.g., "latency_p95")
+  PerfMetricType type;       // Units and direction for this metric.
+  double value = 0.0;        // Measured value.
+  bool measured = false;     // Has a value been measured yet?
+  double full = NAN;         // Value at (or better than) which full credit is given.
+  double zero = NAN;         // Value at (or worse than) which no credit is given.
+  double full_factor = NAN;  // If full target is relative to a reference, by what factor?
+  double zero_factor = NAN;  // If zero target is relative to a reference, by what factor?
+  double reference = NAN;    // Value measured for reference solution, if any.
+  double ci_low = NAN;       // Lower end of confidence interval (if measured repeatedly)
+  double ci_high = NAN;      // Upper end of confidence interval (if measured repeatedly)
+  size_t num_samples = 0;    // Number of samples the value is based on.
+  bool noisy = false;        // Did repeated measurements fail to settle on a value?
+
+  // Parse a target, which may either have units or be a factor relative to the reference.
+  bool ParseTarget(const std::string & in, double & target, double & factor) {
+    if (in.size() && (in.back() == 'x' || in.back() == 'X')) {
+      if (!ParseValue(in.substr(0, in.size()-1), PerfUnit::COUNT, factor)) return false;
+      if (HasReference()) target = factor * reference;
+      return true;
+    }
+    return ParseValue(in, type.unit, target);
+  }
+
+public:
+  PerfMetric() = default;
+  PerfMetric(const std::string & _name) : name(_name), type(GetType(_name)) { }
+  PerfMetric(const PerfMetric &) = default;
+
+  // All of the metrics that a testcase knows how to measure.
+  static const std::map<std::string, PerfMetricType> & GetTypes() {
+    static const std::map<std::string, PerfMetricType> types = {
+      { "latency_p50",       { PerfUnit::SECONDS, false, "Median response latency" } },
+      { "latency_p95",       { PerfUnit::SECONDS, false, "95th percentile response latency" } },
+      { "latency_p99",       { PerfUnit::SECONDS, false, "99th percentile response latency" } },
+      { "responses_per_sec", { PerfUnit::RATE,    true,  "Responses per second" } },
+      { "bytes_per_sec",     { PerfUnit::RATE,    true,  "Input bytes processed per second" } },
+      { "records_per_sec",   { PerfUnit::RATE,    true,  "Input records (lines) processed per second" } },
+      { "mem",               { PerfUnit::BYTES,   false, "Peak memory used (resident set size)" } },
+      { "run_time",          { PerfUnit::SECONDS, false, "Wall-clock time for the executable to run" } },
+      { "read_calls",        { PerfUnit::COUNT,   false, "Read system calls made by the executable" } },
+      { "write_calls",       { PerfUnit::COUNT,   false, "Write system calls made by the executable" } },
+      { "bytes_read",        { PerfUnit::BYTES,   false, "Bytes read by the executable's system calls" } },
+      { "bytes_written",     { PerfUnit::BYTES,   false, "Bytes written by the executable's system calls" } },
+      { "voluntary_switches",   { PerfUnit::COUNT, false, "Times the executable gave up the CPU (e.g., to wait for I/O)" } },
+      { "involuntary_switches", { PerfUnit::COUNT, false, "Times the executable was preempted by the scheduler" } },
+      { "compile_time",      { PerfUnit::SECONDS, false, "Wall-clock time for all compile rules", true } },
+      { "compile_mem",       { PerfUnit::BYTES,   false, "Peak memory used by the compiler", true } },
+      { "exe_size",          { PerfUnit::BYTES,   false, "Size of the executable file", true } },
+      { "obj_size",          { PerfUnit::BYTES,   false, "Size of the test's compiled object file", true } },
+      { "code_size",         { PerfUnit::BYTES,   false, "Machine code in the executable (sum of function sizes)", true } },
+    };
+    return types;
+  }
+
+  static bool IsMetric(const std::string & name) { return GetTypes().count(name); }
+  static PerfMetricType GetType(const std::string & name) {
+    auto it = GetTypes().find(name);
+    emp::notify::TestError(it == GetTypes().end(), "Unknown performance metric '", name, "'.");
+    return it->second;
+  }
+
+  const std::string & GetName() const { return name; }
+  const std::string & GetDesc() const { return type.desc; }
+  double GetValue() const { return value; }
+  bool IsMeasured() const { return measured; }
+  bool HasFull() const { return !std::isnan(full); }
+  bool HasZero() const { return !std::isnan(zero); }
+  bool IsGraded() const { return HasFull() || HasZero(); }
+  double GetReference() const { return reference; }
+  bool HasReference() const { return !std::isnan(reference); }
+  bool HasInterval() const { return !std::isnan(ci_low); }
+  bool IsNoisy() const { return noisy; }
+  bool IsBuildMetric() const { return type.build; }
+  bool NeedsReference() const { return !std::isnan(full_factor) || !std::isnan(zero_factor); }
+
+  void SetValue(double _in) { value = _in; measured = true; }
+
+  // Set the value from repeated measurements, as a median with a confidence interval.
+  void SetValue(double median, double low, double high, size_t samples, bool _noisy) {
+    SetValue(median);
+    ci_low = low;
+    ci_high = high;
+    num_samples = samples;
+    noisy = _noisy;
+  }
+
+  // Record the reference solution's value, filling in any relative targets.
+  void SetReference(double _in) {
+    reference = _in;
+    if (!std::isnan(full_factor)) full = full_factor * reference;
+    if (!std::isnan(zero_factor)) zero = zero_factor * reference;
+  }
+
+  // Forget the reference solution's value (e.g., if it could not be measured), along with any
+  // targets that were relative to it.
+  void ClearReference() {
+    reference = NAN;
+    if (!std::isnan(full_factor)) full = NAN;
+    if (!std::isnan(zero_factor)) zero = NAN;
+  }
+
+  // Parse a target setting for this metric; return false if it can't be parsed.
+  bool SetFull(const std::string & _in) { return ParseTarget(_in, full, full_factor); }
+  bool SetZero(const std::string & _in) { return ParseTarget(_in, zero, zero_factor); }
+
+  // Determine the fraction of credit (0.0 to 1.0) earned by the measured value.
+  double GetCredit() const {
+    if (!IsGraded()) return 1.0;
+    if (!measured) return 0.0;
+    // If measurements never settled, give the benefit of the doubt within the interval.
+    double graded_value = value;
+    if (noisy && HasInterval()) graded_value = type.higher_better ? ci_high : ci_low;
+    const double full_at = HasFull() ? full : zero;
+    const double zero_at = HasZero() ? zero : full;
+    if (full_at == zero_at) {
+      return (type.higher_better ? graded_value >= full_at : graded_value <= full_at) ? 1.0 : 0.0;
+    }
+    // This formula works whether lower or higher values are better.
+    return std::clamp((zero_at - graded_value) / (zero_at - full_at), 0.0, 1.0);
+  }
+
+  // Convert a string with optional units into a number in base units (seconds, bytes, etc.)
+  static bool ParseValue(const std::string & in, PerfUnit unit, double & out) {
+    const char * start = in.c_str();
+    char * end = nullptr;
+    double result = std::strtod(start, &end);
+    if (end == start) return false;
+
+    std::string suffix(end);
+    while (suffix.size() && suffix[0] == ' ') suffix.erase(0,1);
+    for (char & c : suffix) c = static_cast<char>(std::tolower(c));
+
+    double scale = 0.0;
+    switch (unit) {
+    case PerfUnit::COUNT:
+      if (suffix == "") scale = 1.0;
+      break;
+    case PerfUnit::SECONDS:
+      if (suffix == "ns") scale = 0.000000001;
+      else if (suffix == "us") scale = 0.000001;
+      else if (suffix == "ms") scale = 0.001;
+      else if (suffix == "s" || suffix == "") scale = 1.0;
+      break;
+    case PerfUnit::BYTES:
+      if (suffix == "b" || suffix == "") scale = 1.0;
+      else if (suffix == "kb") scale = 1024.0;
+      else if (suffix == "mb") scale = 1024.0 * 1024.0;
+      else if (suffix == "gb") scale = 1024.0 * 1024.0 * 1024.0;
+      break;
+    case PerfUnit::RATE:
+      if (suffix == "" || suffix == "/s") scale = 1.0;
+      else if (suffix == "k" || suffix == "k/s") scale = 1000.0;
+      else if (suffix == "m" || suffix == "m/s") scale = 1000000.0;
+      else if (suffix == "g" || suffix == "g/s") scale = 1000000000.0;
+      break;
+    }
+    if (scale == 0.0) return false;
+    out = result * scale;
+    return true;
+  }
+
+  // Convert a number in base units into a human-readable string.
+  static std::string FormatValue(double value, PerfUnit unit) {
+    std::stringstream ss;
+    ss << std::setprecision(4);
+    switch (unit) {
+    case PerfUnit::COUNT: ss << value; break;
+    case PerfUnit::SECONDS:
+      if (value < 0.000001) ss << value * 1000000000.0 << " ns";
+      else if (value < 0.001) ss << value * 1000000.0 << " us";
+      else if (value < 1.0) ss << value * 1000.0 << " ms";
+      else ss << value << " s";
+      break;
+    case PerfUnit::BYTES:
+      if (value < 1024.0) ss << value << " B";
+      else if (value < 1024.0 * 1024.0) ss << value / 1024.0 << " KB";
+      else if (value < 1024.0 * 1024.0 * 1024.0) ss << value / (1024.0 * 1024.0) << " MB";
+      else ss << value / (1024.0 * 1024.0 * 1024.0) << " GB";
+      break;
+    case PerfUnit::RATE:
+      if (value < 1000.0) ss << value << "/s";
+      else if (value < 1000000.0) ss << value / 1000.0 << "K/s";
+      else if (value < 1000000000.0) ss << value / 1000000.0 << "M/s";
+      else ss << value / 1000000000.0 << "G/s";
+      break;
+    }
+    return ss.str();
+  }
+
+  std::string FormatValue(double in) const { return FormatValue(in, type.unit); }
+  std::string GetValueString() const {
+    if (!measured) return "(not measured)";
+    std::string out = FormatValue(value);
+    if (HasInterval()) {
+      out += " (95% CI " + FormatValue(ci_low) + " to " + FormatValue(ci_high)
+          + "; " + std::to_string(num_samples) + " runs";
+      if (noisy) out += "; noisy, graded at best bound";
+      out += ")";
+    }
+    return out;
+  }
+
+  // Describe the targets for this metric (e.g., "<= 5 ms for full credit")
+  std::string GetTargetString() const {
+    if (NeedsReference() && !HasReference()) return "(reference not measured)";
+    if (!IsGraded()) return "(not graded)";
+    const std::string better = type.higher_better ? ">= " : "<= ";
+    const std::string worse = type.higher_better ? "< " : "> ";
+    if (!HasZero() || !HasFull() || full == zero) {
+      return better + FormatValue(HasFull() ? full : zero) + " required";
+    }
+    return better + FormatValue(full) + " for full credit; " + worse + FormatValue(zero) + " for none";
+  }
+
+  void PrintResults(OutputInfo & output) const {
+    std::ostream & out = output.GetFile();
+    const int credit = static_cast<int>(std::round(GetCredit() * 100.0));
+
+    std::string color = "green";
+    if (credit == 0) color = "red";
+    else if (credit < 100) color = "DarkOrange";
+
+    if (output.IsHTML()) {
+      out << "\nMetric: <b><code>" << name << "</code></b> (" << type.desc << ")\n"
+          << "<table><tr><td>Measured:<td><code>" << GetValueString() << "</code></tr>\n";
+      if (HasReference()) {
+        out << "<tr><td>Reference:<td><code>" << FormatValue(reference) << "</code></tr>\n";
+      }
+      out << "<tr><td>Target:<td><code>" << GetTargetString() << "</code></tr>\n";
+      if (IsGraded()) {
+        out << "<tr><td>Credit:<td><span style=\"color: " << color << "\"><b>"
+            << credit << "%</b></span></tr>\n";
+      }
+      out << "</table><br>\n";
+    } else {
+      out << "\nMetric: " << name << " (" << type.desc << ")\n"
+          << "Measured : " << GetValueString() << "\n";
+      if (HasReference()) out << "Reference: " << FormatValue(reference) << "\n";
+      out << "Target   : " << GetTargetString() << "\n";
+      if (IsGraded()) out << "Credit   : " << credit << "%\n";
+    }
+  }
+};
+
+#endif
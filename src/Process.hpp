@@ -0,0 +1,388 @@
+/**
+ *  @note This file is part of Emperfect, https://github.com/mercere99/Emperfect
+ *  @copyright Copyright (C) Michigan State University, MIT Software license; see doc/LICENSE.md
+ *  @date 2023.
+ *
+ *  @file  Process.hpp
+ *  @brief A child process that Emperfect can talk to over pipes while it runs.
+ *
+ *  Commands are run through "/bin/sh -c exec ..." so that arguments and redirects behave the
+ *  same as with std::system(), but the process ID we track is the program itself.  Resource use
+ *  reported by wait4() includes any children the program waited on (e.g., the compiler proper
+ *  launched by g++).
+ */
+
+#ifndef EMPERFECT_PROCESS_HPP
+#define EMPERFECT_PROCESS_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/personality.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+class Process {
+public:
+  using clock_t = std::chrono::steady_clock;
+  using time_point_t = clock_t::time_point;
+
+  // I/O done by a child, from /proc/<pid>/io; counts every read() or write() style call, including
+  // those served from the page cache.
+  struct IOCounts {
+    size_t bytes_read = 0;     // Bytes read (rchar).
+    size_t bytes_written = 0;  // Bytes written (wchar).
+    size_t read_calls = 0;     // Read system calls (syscr).
+    size_t write_calls = 0;    // Write system calls (syscw).
+  };
+
+private:
+  static inline volatile std::sig_atomic_t cancel_all = 0;  // Should all children be stopped?
+
+  std::string command;        // Shell command to run.
+  std::string input_file;     // File to use as standard input (if not piped).
+  int input_source = -1;      // Open descriptor to use as standard input instead (closed once started).
+  std::string output_file;    // File to use as standard output (if not piped).
+  std::string error_file;     // File to use as standard error.
+  bool pipe_input = false;    // Should we write to the child's standard input?
+  bool pipe_output = false;   // Should we read from the child's standard output?
+  int cpu = -1;               // CPU to pin the child to (-1 for any)
+  bool aslr = true;           // Should address-space layout randomization be left on?
+  bool exec = true;           // Should the shell be replaced by the command?
+  size_t memory_limit = 0;    // Most memory the whole process group may use (0 for no limit)
+  std::vector<std::pair<std::string, std::string>> env;  // Extra environment variables for the child.
+  std::string work_dir;       // Directory for the child to run in (after opening its files).
+  int nice_level = 0;         // Priority (nice level) to give the child (0 to leave unchanged).
+
+  pid_t pid = -1;             // ID of the child process (-1 if not running)
+  int input_fd = -1;          // Our end of the pipe to the child's standard input.
+  int output_fd = -1;         // Our end of the pipe from the child's standard output.
+  std::string buffer;         // Output read from the child, but not yet returned.
+  bool output_done = false;   // Has the child closed its standard output?
+
+  // -- Results --
+  int exit_code = -1;         // Exit code (or 128+signal if killed by a signal)
+  bool hit_timeout = false;   // Did we need to stop the child?
+  bool hit_memory = false;    // Did we stop the child for using too much memory?
+  time_point_t start_time;    // When did the child start running?
+  double run_time = 0.0;      // How many seconds did the child run?
+  rusage usage{};             // Resources used by the child (filled in once it finishes).
+  IOCounts io;                // I/O done by the child itself (filled in once it finishes).
+
+  // Redirect a standard file descriptor in the child to a named file.
+  static void RedirectToFile(const std::string & filename, int target_fd, int flags) {
+    if (filename.empty()) return;
+    int fd = open(filename.c_str(), flags, 0644);
+    if (fd < 0) _exit(127);
+    dup2(fd, target_fd);
+    close(fd);
+  }
+
+  // Total the resident memory of every process in the child's process group.
+  size_t GetGroupMemory() const {
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t total = 0;
+    std::error_code error;
+    for (const auto & entry : std::filesystem::directory_iterator("/proc", error)) {
+      std::ifstream stat_file(entry.path() / "stat");
+      std::string stat;
+      if (!std::getline(stat_file, stat)) continue;
+      // Fields after the command name (which is in parens): state ppid pgrp ... rss is field 24.
+      const size_t close_pos = stat.rfind(')');
+      if (close_pos == std::string::npos) continue;
+      std::stringstream ss(stat.substr(close_pos+2));
+      std::string field;
+      long pgrp = 0, rss = 0;
+      for (size_t i = 3; i <= 24 && ss >> field; ++i) {
+        if (i == 5) pgrp = std::atol(field.c_str());
+        if (i == 24) rss = std::atol(field.c_str());
+      }
+      if (pgrp == pid && rss > 0) total += static_cast<size_t>(rss) * page_size;
+    }
+    return total;
+  }
+
+  // Read the I/O counters of the child (which must not have been reaped yet).
+  void ReadIOCounts() {
+    io = IOCounts{};
+    std::ifstream io_file("/proc/" + std::to_string(pid) + "/io");
+    std::string name;
+    size_t value = 0;
+    while (io_file >> name >> value) {
+      if (name == "rchar:") io.bytes_read = value;
+      else if (name == "wchar:") io.bytes_written = value;
+      else if (name == "syscr:") io.read_calls = value;
+      else if (name == "syscw:") io.write_calls = value;
+    }
+  }
+
+  // Wait until a file descriptor is ready (or deadline passes); return false on timeout.
+  static bool WaitFD(int fd, short events, time_point_t deadline) {
+    while (true) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock_t::now());
+      if (remaining.count() < 0 || cancel_all) return false;
+      pollfd pfd{fd, events, 0};
+      int result = poll(&pfd, 1, static_cast<int>(remaining.count()) + 1);
+      if (result > 0) return true;
+      if (result < 0 && errno != EINTR) return true; // Let the following read/write report the error.
+    }
+  }
+
+public:
+  Process(const std::string & _command) : command(_command) { }
+  Process(const Process &) = delete;
+  ~Process() {
+    Kill();
+    CloseInput();
+    if (input_source >= 0) close(input_source);
+    if (output_fd >= 0) close(output_fd);
+  }
+
+  // Stop all children as soon as possible (safe to call from a signal handler).
+  static void CancelAll() { cancel_all = 1; }
+  static bool IsCancelled() { return cancel_all; }
+
+  int GetExitCode() const { return exit_code; }
+  bool HitTimeout() const { return hit_timeout; }
+  bool HitMemoryLimit() const { return hit_memory; }
+  double GetRunTime() const { return run_time; }
+  const rusage & GetUsage() const { return usage; }
+  const IOCounts & GetIOCounts() const { return io; }
+  size_t GetVoluntarySwitches() const { return static_cast<size_t>(usage.ru_nvcsw); }
+  size_t GetInvoluntarySwitches() const { return static_cast<size_t>(usage.ru_nivcsw); }
+  size_t GetPeakMemory() const { return static_cast<size_t>(usage.ru_maxrss) * 1024; } // KB -> bytes
+  bool IsRunning() const { return pid > 0; }
+  time_point_t GetStartTime() const { return start_time; }
+
+  Process & SetInputFile(const std::string & _in) { input_file = _in; return *this; }
+  Process & SetInputFD(int _in) { input_source = _in; return *this; }  // Takes ownership of the descriptor.
+  Process & SetOutputFile(const std::string & _in) { output_file = _in; return *this; }
+  Process & SetErrorFile(const std::string & _in) { error_file = _in; return *this; }
+  Process & PipeInput() { pipe_input = true; return *this; }
+  Process & PipeOutput() { pipe_output = true; return *this; }
+  Process & SetCPU(int _in) { cpu = _in; return *this; }
+  Process & SetASLR(bool _in) { aslr = _in; return *this; }
+  Process & UseShell() { exec = false; return *this; }  // Allow chained commands (e.g., "a && b")
+  Process & SetMemoryLimit(size_t _in) { memory_limit = _in; return *this; }
+  Process & SetWorkDir(const std::string & _in) { work_dir = _in; return *this; }
+  Process & SetNice(int _in) { nice_level = _in; return *this; }
+  Process & SetEnv(const std::string & name, const std::string & value) {
+    env.emplace_back(name, value);
+    return *this;
+  }
+
+  // Launch the child process; return false if it could not be started.
+  bool Start() {
+    if (cancel_all) return false;
+    std::signal(SIGPIPE, SIG_IGN);   // A child closing its input should not kill Emperfect.
+
+    int in_pipe[2] = {-1, -1};
+    int out_pipe[2] = {-1, -1};
+    if (pipe_input && pipe(in_pipe) != 0) return false;
+    if (pipe_output && pipe(out_pipe) != 0) return false;
+
+    start_time = clock_t::now();
+    pid = fork();
+    if (pid < 0) return false;
+
+    // Child process: hook up standard streams and run the command.
+    if (pid == 0) {
+      setpgid(0, 0);  // Use our own process group so any helpers can be stopped with us.
+      if (pipe_input) { dup2(in_pipe[0], STDIN_FILENO); close(in_pipe[0]); close(in_pipe[1]); }
+      else if (input_source >= 0) dup2(input_source, STDIN_FILENO);
+      else RedirectToFile(input_file, STDIN_FILENO, O_RDONLY);
+      if (pipe_output) { dup2(out_pipe[1], STDOUT_FILENO); close(out_pipe[0]); close(out_pipe[1]); }
+      else RedirectToFile(output_file, STDOUT_FILENO, O_WRONLY | O_CREAT | O_TRUNC);
+      RedirectToFile(error_file, STDERR_FILENO, O_WRONLY | O_CREAT | O_TRUNC);
+
+      // Reduce measurement noise if requested; both settings are kept across exec.
+      if (cpu >= 0) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+      }
+      if (!aslr) personality(ADDR_NO_RANDOMIZE);
+      if (nice_level) setpriority(PRIO_PROCESS, 0, nice_level);
+      for (const auto & [name, value] : env) setenv(name.c_str(), value.c_str(), 1);
+      if (work_dir.size() && chdir(work_dir.c_str()) != 0) _exit(127);
+
+      const std::string exec_command = exec ? ("exec " + command) : command;
+      execl("/bin/sh", "sh", "-c", exec_command.c_str(), static_cast<char *>(nullptr));
+      _exit(127);
+    }
+
+    // Parent process: keep only our ends of the pipes.
+    if (input_source >= 0) { close(input_source); input_source = -1; }
+    if (pipe_input) { close(in_pipe[0]); input_fd = in_pipe[1]; }
+    if (pipe_output) { close(out_pipe[1]); output_fd = out_pipe[0]; }
+    return true;
+  }
+
+  // Write data to the child's standard input; return false if it can't all be written in time.
+  bool Write(const std::string & data, time_point_t deadline) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+      if (!WaitFD(input_fd, POLLOUT, deadline)) return false;
+      ssize_t count = write(input_fd, data.data() + pos, data.size() - pos);
+      if (count < 0) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+      pos += static_cast<size_t>(count);
+    }
+    return true;
+  }
+
+  // Feed all of the input to the child while collecting its output, so that neither side blocks.
+  // The callback (if any) is run whenever more input is accepted, with the total bytes so far.
+  // Returns false if the deadline passed first.
+  bool Stream(const std::string & input, std::string & output, time_point_t deadline,
+              std::function<void(size_t)> on_progress=nullptr) {
+    fcntl(input_fd, F_SETFL, fcntl(input_fd, F_GETFL) | O_NONBLOCK);
+    size_t pos = 0;
+    if (input.empty()) CloseInput();
+    while (input_fd >= 0 && !output_done) {
+      pollfd pfds[2] = { {input_fd, POLLOUT, 0}, {output_fd, POLLIN, 0} };
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock_t::now());
+      if (remaining.count() < 0 || cancel_all) return false;
+      if (poll(pfds, 2, static_cast<int>(remaining.count()) + 1) < 0 && errno != EINTR) return false;
+
+      if (pfds[0].revents) {
+        ssize_t count = write(input_fd, input.data() + pos, input.size() - pos);
+        if (count < 0 && errno != EAGAIN && errno != EINTR) CloseInput(); // Child stopped reading.
+        else if (count > 0) {
+          pos += static_cast<size_t>(count);
+          if (on_progress) on_progress(pos);
+          if (pos == input.size()) CloseInput();
+        }
+      }
+      if (pfds[1].revents && ReadChunk(deadline)) {
+        output += buffer;
+        buffer.clear();
+      }
+    }
+    CloseInput();
+    output += ReadAll(deadline);
+    return output_done;
+  }
+
+  // Signal end-of-file on the child's standard input.
+  void CloseInput() {
+    if (input_fd >= 0) close(input_fd);
+    input_fd = -1;
+  }
+
+  // Read the next chunk of output; return false at end-of-file or when the deadline passes.
+  bool ReadChunk(time_point_t deadline) {
+    if (output_done) return false;
+    if (!WaitFD(output_fd, POLLIN, deadline)) return false;
+    char chunk[4096];
+    ssize_t count = read(output_fd, chunk, sizeof(chunk));
+    if (count < 0 && errno == EINTR) return true;
+    if (count <= 0) { output_done = true; return false; }
+    buffer.append(chunk, static_cast<size_t>(count));
+    return true;
+  }
+
+  // Read a single line of output (without the newline); return false if none arrives in time.
+  bool ReadLine(std::string & line, time_point_t deadline) {
+    size_t newline_pos;
+    while ((newline_pos = buffer.find('\n')) == std::string::npos) {
+      if (!ReadChunk(deadline)) {
+        if (!output_done || buffer.empty()) return false;
+        line = buffer;          // Last line had no newline at the end.
+        buffer.clear();
+        return true;
+      }
+    }
+    line = buffer.substr(0, newline_pos);
+    buffer.erase(0, newline_pos+1);
+    return true;
+  }
+
+  // Read exactly count bytes of output; returns fewer only if the output ends (or deadline passes).
+  std::string Read(size_t count, time_point_t deadline) {
+    while (buffer.size() < count && ReadChunk(deadline));
+    std::string out = buffer.substr(0, count);
+    buffer.erase(0, out.size());
+    return out;
+  }
+
+  // Read all remaining output until the child closes it (or the deadline passes).
+  std::string ReadAll(time_point_t deadline) {
+    while (ReadChunk(deadline));
+    std::string out = std::move(buffer);
+    buffer.clear();
+    return out;
+  }
+
+  // Wait for the child to finish, stopping it if it goes past the deadline (or the memory limit).
+  // Returns true if the process finished on its own.
+  bool Wait(time_point_t deadline) {
+    if (pid <= 0) return !hit_timeout && !hit_memory;
+    CloseInput();
+
+    // Wait for the child to finish without reaping it, so its I/O counters can still be read.
+    int status = 0;
+    siginfo_t info{};
+    auto sleep_time = std::chrono::microseconds(100);
+    auto next_memory_check = clock_t::now();
+    while (true) {
+      info.si_pid = 0;
+      if (waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOHANG | WNOWAIT) != 0) {
+        if (errno == EINTR) continue;
+        break;
+      }
+      if (info.si_pid != 0) break;  // Finished.
+      const auto now = clock_t::now();
+      if (memory_limit && now >= next_memory_check) {
+        hit_memory = GetGroupMemory() > memory_limit;
+        next_memory_check = now + std::chrono::milliseconds(20);
+      }
+      if (now >= deadline || hit_memory || cancel_all) {
+        hit_timeout = !hit_memory && !cancel_all;
+        kill(-pid, SIGKILL);
+        kill(pid, SIGKILL);
+        while (waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT) != 0 && errno == EINTR);
+        break;
+      }
+      std::this_thread::sleep_for(sleep_time);
+      if (sleep_time < std::chrono::milliseconds(10)) sleep_time *= 2;
+    }
+    ReadIOCounts();
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR);
+    run_time = std::chrono::duration<double>(clock_t::now() - start_time).count();
+    pid = -1;
+
+    if (WIFEXITED(status)) exit_code = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status)) exit_code = 128 + WTERMSIG(status);
+    return !hit_timeout && !hit_memory;
+  }
+
+  // Stop the child (and anything it launched) immediately.
+  void Kill() {
+    if (pid <= 0) return;
+    kill(-pid, SIGKILL);
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    pid = -1;
+  }
+};
+
+#endif
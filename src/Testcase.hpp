@@ -12,19 +12,33 @@
 #ifndef EMPERFECT_TESTCASE_HPP
 #define EMPERFECT_TESTCASE_HPP
 
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+
 #include "emp/base/vector.hpp"
 #include "emp/tools/String.hpp"
 #include "dtl.hpp"
 #include "CheckInfo.hpp"
+#include "FixturePack.hpp"
+#include "OutputCompare.hpp"
+#include "PerfMetric.hpp"
 
 enum class TestStatus {
   PASSED = 0,
   FAILED_COMPILE, // Compilation failed.
+  FAILED_COMPILE_LIMIT, // Compilation was stopped for using too much time or memory.
   FAILED_CHECK,   // Failed one of the CHECK statements.
   FAILED_TIME,    // Took too long and had a timeout.
   FAILED_RUN,     // Had an error output during run.
   FAILED_OUTPUT,  // Output didn't match expected.
-  MISSED_ERROR    // Wrong error code was returned.
+  MISSED_ERROR,   // Wrong error code was returned.
+  FAILED_PERF,    // Missed all credit for a performance target.
+  FAILED_FIXTURE, // The setup code of this test's fixture failed or timed out.
+  PENDING         // Not run yet (deferred until after visible tests are reported).
 };
 
 class Testcase {
@@ -36,10 +50,16 @@ private:
   double points = 0.0;       // Number of points this test case is worth.
 
   emp::String input_filename;  // Name of file to feed as standard input, if any.
+  emp::String input_gen;       // Command to generate standard input, if any.
   emp::String expect_filename; // Name of file to compare against standard output.
   emp::String code_filename;   // Name of file with code to test.
   emp::String args;            // Command-line arguments.
+  emp::String reference_command; // Command to run a reference solution for comparison, if any.
+  emp::String fixture;         // Name of the :Fixture whose setup this testcase starts from, if any.
+  emp::vector<std::pair<emp::String, emp::String>> compare_files; // Files the program writes, with expected versions.
+  emp::String work_dir;        // Directory the executable runs in (if it writes files to compare).
   int expect_exit_code = 0;    // The expected exist code.
+  const FixturePack * pack = nullptr; // Pack holding any "pack:" inputs or expected outputs.
 
   // Names for generated files.
   emp::String cpp_filename;     // To create with C++ code for this test
@@ -48,32 +68,82 @@ private:
   emp::String output_filename;  // To collect output generated by executable.
   emp::String error_filename;   // To collect errors generated by executable.
   emp::String result_filename;  // To log results for test checks.
+  emp::String heartbeat_filename; // Shared with the executable to track which check is running.
 
   // Testcase run configs.
   bool call_main = true;     // Should main() function be called?
   bool hidden = false;       // Should this test case be seen by students?
   bool match_case = true;    // Does case need to match perfectly in the output?
   bool match_space = true;   // Does whitespace need to match perfectly in the output?
+  bool latency_mode = false; // Should input lines be sent one at a time, timing each response?
+  bool throughput_mode = false; // Should we measure how quickly the input is processed?
+  double warmup = 0.1;       // Fraction of input records to process before measuring throughput.
   size_t timeout = 5;        // How many seconds should this testcase be allowed run?
 
+  // Settings for repeated runs of performance tests.
+  size_t repeat_warmup = 1;  // Number of initial runs to discard.
+  size_t repeat_min = 5;     // Minimum number of measured runs.
+  size_t repeat_max = 20;    // Maximum number of measured runs.
+  double repeat_ci = 0.05;   // Target confidence interval width, relative to the median.
+  int pin_cpu = -1;          // Which CPU should the executable run on? (-1 for any)
+  bool aslr = true;          // Should address-space layout randomization be used?
+  bool build_stats = false;  // Should compile time, compiler memory, and binary sizes be reported?
+  bool io_stats = false;     // Should I/O system calls, bytes, and context switches be reported?
+  size_t symbol_sizes = 0;   // How many of the largest functions in the executable should be listed?
+  double rerun_margin = -1.0; // Rerun if within this % of the timeout (or timed out); -1 for never.
+
   // -- Configured elsewhere --
   string_block_t code;       // The actual code associated with this test case.
   emp::String processed_code; // Code after ${} are filled in and collapsed to one string.
   emp::String filename;      // What file is this test case originally in?
   size_t start_line = 0;     // At which line number is this test case start?
   size_t end_line = 0;       // At which line does this test case end?
+  size_t constexpr_probes = 0; // How many CHECK_CONSTEXPR expressions have been probed?
 
   std::vector<CheckInfo> checks;
+  std::map<std::string, PerfMetric> metrics;  // Performance measurements (and targets) by name.
 
   // -- Results --
+  bool pending = false;        // Is this testcase waiting to be run in the deferred lane?
   int compile_exit_code = -1;  // Exit code from compilation (results compiler_filename)
+  emp::String compile_limit;   // Compile limit that was exceeded, if any (e.g., "time limit of 60 seconds")
+  emp::String fixture_error;   // How this test's fixture setup failed, if it did (e.g., "timed out")
   int run_exit_code = -1;      // Exit code from running the test.
   bool output_match = true;    // Did exe output match expected output?
+  emp::vector<emp::String> output_mismatches; // Where each mismatched output first differed.
   bool hit_timeout = false;    // Did this testcase need to be halted?
+  long long timeout_check = -1; // ID of the check that was running when halted (-1 if none).
+  long long last_check = -1;   // ID of the last check finished before being halted (-1 if none).
+  size_t checks_finished = 0;  // Number of checks finished before being halted.
+  size_t checks_passed = 0;    // Number of checks passed before being halted.
+  size_t peak_memory = 0;      // Most memory (in bytes) used at once by the executable.
+  double run_time = 0.0;       // Seconds the executable took to run (the last time).
+  std::vector<std::pair<std::string, size_t>> largest_symbols; // Biggest functions (name, bytes)
   double score = 0.0;          // Final score awarded for this testcase.
 
+  // -- Results from the first run, if the test was rerun for being close to its timeout --
+  bool reran = false;          // Was this test run a second time?
+  double first_run_time = 0.0; // Seconds the first run took.
+  emp::String first_status;    // Result of the first run (e.g., "Timed Out").
+
   // Helper functions
 
+  // Read the full contents of an input or expected-output file, which may be in the fixture pack.
+  std::string ReadFixture(const emp::String & filename) const {
+    if (FixturePack::IsPacked(filename)) return pack ? std::string(pack->Get(filename)) : "";
+    std::ifstream file(filename);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  // Load an input or expected-output file line by line, which may be in the fixture pack.
+  emp::File LoadFixture(const emp::String & filename) const {
+    if (!FixturePack::IsPacked(filename)) return emp::File(filename);
+    std::istringstream contents(ReadFixture(filename));
+    emp::File file;
+    file.Load(contents);
+    return file;
+  }
+
   // Determine how many tests match a particular lambda.
   size_t CountIf(auto test) const {
     return std::count_if(checks.begin(), checks.end(), test);
@@ -129,8 +199,31 @@ public:
     return CountIf([](const auto & check){ return !check.Passed(); });
   }
 
+  // Did this test time out, or come close enough that it should be rerun on a quieter grader?
+  bool IsNearTimeout() const {
+    if (rerun_margin < 0.0 || reran || compile_exit_code) return false;
+    return hit_timeout || run_time >= timeout * (1.0 - rerun_margin / 100.0);
+  }
+
+  // Remove the results of a run (keeping the compiled test), so it can be run again.  Checks
+  // evaluated at compile time keep their results, since rerunning won't record them again.
+  void ClearResults() {
+    for (auto & check : checks) if (!check.IsCompileTime()) check.ClearResults();
+    run_exit_code = -1;
+    output_match = true;
+    output_mismatches.resize(0);
+    hit_timeout = false;
+    timeout_check = last_check = -1;
+    checks_finished = checks_passed = 0;
+    score = 0.0;
+  }
+
   TestStatus GetStatus() const {
-    if (compile_exit_code) return TestStatus::FAILED_COMPILE;
+    if (pending) return TestStatus::PENDING;
+    if (compile_exit_code) {
+      return compile_limit.size() ? TestStatus::FAILED_COMPILE_LIMIT : TestStatus::FAILED_COMPILE;
+    }
+    if (fixture_error.size()) return TestStatus::FAILED_FIXTURE;
     if (hit_timeout) return TestStatus::FAILED_TIME;
     if (run_exit_code != expect_exit_code) {
       if (expect_exit_code) return TestStatus::MISSED_ERROR;
@@ -138,20 +231,29 @@ public:
     }
     if (CountPassed() != checks.size()) return TestStatus::FAILED_CHECK;
     if (!output_match) return TestStatus::FAILED_OUTPUT;
+    if (PerfCredit() == 0.0) return TestStatus::FAILED_PERF;
     return TestStatus::PASSED;
   }
 
   emp::String GetStatusString() const {
     switch (GetStatus()) {
-    case TestStatus::PASSED: return "Passing";
+    case TestStatus::PASSED:
+      if (PerfCredit() < 1.0) {
+        return emp::MakeString("Passing (", std::round(PerfCredit() * 100.0), "% performance credit)");
+      }
+      return "Passing";
     case TestStatus::FAILED_CHECK: return "Checks Failing";
     case TestStatus::FAILED_COMPILE: return "Compilation Error";
+    case TestStatus::FAILED_COMPILE_LIMIT: return "Compilation Stopped";
     case TestStatus::FAILED_TIME: return "Timed Out";
     case TestStatus::FAILED_RUN: return "Error During Run";
     case TestStatus::FAILED_OUTPUT: return "Incorrect Output";
     case TestStatus::MISSED_ERROR:
       return emp::MakeString("Wrong exit code (expected ", expect_exit_code,
                              " received ", run_exit_code, ")");
+    case TestStatus::FAILED_PERF: return "Missed Performance Targets";
+    case TestStatus::FAILED_FIXTURE: return "Fixture Setup Failed";
+    case TestStatus::PENDING: return "Pending";
     }
     return "Unknown";
   }
@@ -159,6 +261,11 @@ public:
   bool Passed() const { return GetStatus() == TestStatus::PASSED; }
   bool Failed() const { return !Passed(); }
 
+  // Are there any checks of a given type (e.g., those evaluated from compiler output)?
+  bool HasChecks(CheckType type) const {
+    return CountIf([type](const auto & check){ return check.GetType() == type; });
+  }
+
   // Test if a check at particular line number passed.
   bool Passed(size_t test_id) const {
     for (const auto & check : checks) {
@@ -167,52 +274,93 @@ public:
     return false; // No check here.
   }
 
-  double EarnedPoints() const { return Passed() ? points : 0.0; }
+  // Find the fraction of points earned for performance (the lowest credit of any graded metric).
+  double PerfCredit() const {
+    double credit = 1.0;
+    for (const auto & [name, metric] : metrics) credit = std::min(credit, metric.GetCredit());
+    return credit;
+  }
 
-  // Convert all CHECK macros.
-  emp::String ProcessChecks() {
-    // Take an input line and convert "CHECK" macro into full analysis and output code.
-    emp::String out_code = processed_code.ReplaceMacro("CHECK(", ")",
-      [this](const std::string & check_body, size_t line_num, size_t check_id){
-        emp::String location =
-          emp::MakeString("Testcase #", id, ", Line", line_num, " (check ", check_id, ")");
-        checks.emplace_back(check_body, location, check_id, CheckType::ASSERT);
-        return checks.back().ToCPP();
-      });
+  double EarnedPoints() const { return Passed() ? points * PerfCredit() : 0.0; }
+
+  // Does this testcase measure any performance metrics that need repeated runs?
+  bool IsPerfTest() const {
+    if (latency_mode || throughput_mode) return true;
+    for (const auto & [name, metric] : metrics) {
+      if (metric.IsGraded() && !metric.IsBuildMetric()) return true;
+    }
+    return false;
+  }
+
+  // Get a performance metric for this testcase, creating it if needed.
+  PerfMetric & GetMetric(const std::string & name) {
+    auto it = metrics.find(name);
+    if (it == metrics.end()) it = metrics.emplace(name, PerfMetric(name)).first;
+    return it->second;
+  }
 
-    // Take an input line and convert "CHECK" macro into full analysis and output code.
-    out_code = emp::replace_macro(out_code, "CHECK_TYPE",
-      [this](const std::string & check_body, size_t line_num, size_t check_id){
-        emp::String location =
-          emp::MakeString("Testcase #", id, ", Line", line_num, " (check ", check_id, ")");
-        checks.emplace_back(check_body, location, check_id, CheckType::TYPE_COMPARE);
-        return checks.back().ToCPP();
+  // Convert all CHECK macros.  The probe function determines if an expression can be
+  // evaluated at compile time (for CHECK_CONSTEXPR).
+  emp::String ProcessChecks(std::function<ConstexprResult(const emp::String &)> constexpr_probe) {
+    // Record a check found in the code.
+    auto record_check = [this](const std::string & check_body, size_t line_num, size_t check_id,
+                               CheckType type) -> CheckInfo & {
+      emp::String location =
+        emp::MakeString("Testcase #", id, ", Line", line_num, " (check ", check_id, ")");
+      checks.emplace_back(check_body, location, check_id, type);
+      return checks.back();
+    };
+
+    // Build a converter from one kind of CHECK macro into full analysis and output code.
+    auto add_check = [&record_check](CheckType type) {
+      return [&record_check, type](const std::string & check_body, size_t line_num, size_t check_id){
+        return record_check(check_body, line_num, check_id, type).ToCPP();
+      };
+    };
+
+    emp::String out_code = processed_code.ReplaceMacro("CHECK(", ")", add_check(CheckType::ASSERT));
+    out_code = emp::replace_macro(out_code, "CHECK_TYPE", add_check(CheckType::TYPE_COMPARE));
+
+    // Optimization checks are evaluated using the compiler's optimization report.
+    out_code = emp::replace_macro(out_code, "CHECK_VECTORIZED", add_check(CheckType::VECTORIZED));
+    out_code = emp::replace_macro(out_code, "CHECK_INLINED", add_check(CheckType::INLINED));
+
+    // Machine-code checks are evaluated by disassembling the executable.
+    out_code = emp::replace_macro(out_code, "CHECK_CODEGEN", add_check(CheckType::CODEGEN));
+
+    // CHECK_CONSTEXPR is evaluated at compile time, by probing whether its expression compiles.
+    out_code = emp::replace_macro(out_code, "CHECK_CONSTEXPR",
+      [&record_check, &constexpr_probe](const std::string & check_body, size_t line_num, size_t check_id){
+        CheckInfo & check = record_check(check_body, line_num, check_id, CheckType::CONSTEXPR);
+        check.SetConstexprResult( constexpr_probe(check.GetTest().GetLHS()) );
+        return check.ToCPP();
       });
 
     return out_code;
   }
 
   
-  // Generate a C++ file for internal testing with the provided header.
-  void GenerateTestCPP(const emp::String & header) {
-    // If we are using a file for test code, load it in.
-    if (code_filename.size()) {
-      emp::notify::TestError(code.size(),
-        "Test case ", id, " cannot have both a code filename and in-place code provided.");
-
-      emp::File file(code_filename);
-      code = file.GetAllLines();
-    }
+  // If we are using a file for test code, load it in.
+  void LoadCodeFile() {
+    if (code_filename.empty()) return;
+    emp::notify::TestError(code.size(),
+      "Test case ", id, " cannot have both a code filename and in-place code provided.");
+
+    emp::File file(code_filename);
+    code = file.GetAllLines();
+  }
 
-    // Start with boilerplate.
-    std::cout << "Creating: " << cpp_filename << std::endl;
-    std::ofstream cpp_file(cpp_filename);
+  // Print the boilerplate that every generated test file starts with.
+  static void PrintSupportCPP(std::ostream & cpp_file, const emp::String & header) {
     cpp_file
       << "// This is a test file autogenerated by Emperfect.\n"
       << "// See: https://github.com/mercere99/Emperfect\n\n""
       << header << "\n"
+      << "#include <chrono>\n"
+      << "#include <cstdlib>\n"
       << "#include <fstream>\n"
       << "#include <iostream>\n"
+      << "#include <map>\n"
       << "#include <unordered_map>\n"
       << "#include <sstream>\n"
       << "#include <string>\n"
@@ -220,6 +368,9 @@ public:
       << "#include <type_traits>\n"
       << "#include <vector>\n"
       << "#include <cstdint>\n"
+      << "#include <fcntl.h>\n"
+      << "#include <sys/mman.h>\n"
+      << "#include <unistd.h>\n"
       << "\n"
       << "// Extract information about a function.\n"
       << "template <typename... Ts> struct FunInfo;\n"
@@ -328,16 +479,84 @@ public:
       << "  ss << val;\n"
       << "  return to_literal(ss.str());\n"
       << "}\n"
+      << "\n"
+      << "// Track time spent in each CHECK (by check ID) to report with the results.  Totals so far\n"
+      << "// are also written as checks finish, so they are available if the test is stopped early.\n"
+      << "struct _emperfect_timing_t {\n"
+      << "  size_t count = 0; double total = 0.0, min = 0.0, max = 0.0;\n"
+      << "  std::chrono::steady_clock::time_point reported;\n"
+      << "};\n"
+      << "static std::map<size_t, _emperfect_timing_t> _emperfect_timing;\n"
+      << "static std::ostream * _emperfect_timing_out = nullptr;\n"
+      << "void _emperfect_report_time(std::ostream & out, size_t id, const _emperfect_timing_t & timing) {\n"
+      << "  out << \":TIME: \" << id << \" \" << timing.count << \" \" << timing.total\n"
+      << "      << \" \" << timing.min << \" \" << timing.max << \"\\n\";\n"
+      << "}\n"
+      << "\n"
+      << "// Heartbeat shared with Emperfect (through the file in EMPERFECT_HEARTBEAT), so it can tell\n"
+      << "// where a test was if it must be stopped: [0] = running check ID + 1 (0 for none),\n"
+      << "// [1] = last finished check ID + 1, [2] = checks finished, [3] = checks passed.\n"
+      << "static volatile long long * _emperfect_heartbeat = [](){\n"
+      << "  static long long unused[4] = {0, 0, 0, 0};\n"
+      << "  const char * filename = std::getenv(\"EMPERFECT_HEARTBEAT\");\n"
+      << "  int fd = filename ? open(filename, O_RDWR) : -1;\n"
+      << "  if (fd < 0) return static_cast<volatile long long *>(unused);\n"
+      << "  void * ptr = mmap(nullptr, sizeof(unused), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);\n"
+      << "  close(fd);\n"
+      << "  return static_cast<volatile long long *>(ptr == MAP_FAILED ? unused : ptr);\n"
+      << "}();\n"
+      << "\n"
+      << "std::chrono::steady_clock::time_point _emperfect_check_begin(size_t id) {\n"
+      << "  _emperfect_heartbeat[0] = static_cast<long long>(id) + 1;\n"
+      << "  return std::chrono::steady_clock::now();\n"
+      << "}\n"
+      << "void _emperfect_check_end(size_t id, bool success, std::chrono::steady_clock::time_point start) {\n"
+      << "  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();\n"
+      << "  _emperfect_heartbeat[0] = 0;\n"
+      << "  _emperfect_heartbeat[1] = static_cast<long long>(id) + 1;\n"
+      << "  _emperfect_heartbeat[2] = _emperfect_heartbeat[2] + 1;\n"
+      << "  if (success) _emperfect_heartbeat[3] = _emperfect_heartbeat[3] + 1;\n"
+      << "  _emperfect_timing_t & timing = _emperfect_timing[id];\n"
+      << "  if (timing.count == 0 || seconds < timing.min) timing.min = seconds;\n"
+      << "  if (timing.count == 0 || seconds > timing.max) timing.max = seconds;\n"
+      << "  timing.total += seconds;\n"
+      << "  timing.count++;\n"
+      << "  // Checks inside loops are written out at most every 0.1 seconds to keep overhead low.\n"
+      << "  const auto now = std::chrono::steady_clock::now();\n"
+      << "  if (_emperfect_timing_out && (timing.count == 1 || now - timing.reported >= std::chrono::milliseconds(100))) {\n"
+      << "    _emperfect_report_time(*_emperfect_timing_out, id, timing);\n"
+      << "    _emperfect_timing_out->flush();\n"
+      << "    timing.reported = now;\n"
+      << "  }\n"
+      << "}\n"
+      << "void _emperfect_report_times(std::ostream & out) {\n"
+      << "  for (const auto & [id, timing] : _emperfect_timing) _emperfect_report_time(out, id, timing);\n"
+      << "  _emperfect_timing_out = nullptr;\n"
+      << "}\n";
+  }
+
+  // Generate a C++ file for internal testing with the provided header.
+  void GenerateTestCPP(const emp::String & header,
+                       std::function<ConstexprResult(const emp::String &)> constexpr_probe) {
+    LoadCodeFile();
+
+    // Start with boilerplate.
+    std::cout << "Creating: " << cpp_filename << std::endl;
+    std::ofstream cpp_file(cpp_filename);
+    PrintSupportCPP(cpp_file, header);
+    cpp_file
       << "void _emperfect_main() {\n"
       << "  std::ofstream _emperfect_results(\"" << result_filename << "\");\n"
+      << "  _emperfect_timing_out = &_emperfect_results;\n"
       << "  size_t _emperfect_error_count = 0;\n"
       << "  [[maybe_unused]] size_t _emperfect_check_id = 0;\n\n";
 
     // Add updated code for this specific test.
-    cpp_file << ProcessChecks() << "\n";
+    cpp_file << ProcessChecks(constexpr_probe) << "\n";
 
     // Close out the main and make sure it get's run appropriately.
     cpp_file
+      << "  _emperfect_report_times(_emperfect_results);\n"
       << "  _emperfect_results << \"SCORE \" << (!_emperfect_error_count ? "
           << points << " : 0) << \"\\n\";\n"
       << "}\n\n"
@@ -352,6 +571,28 @@ public:
       << "static _emperfect_runner runner;\n";
   }
 
+  // Add this testcase to the generated file for its fixture.  The test becomes a lambda inside
+  // the fixture's function (so it can use the variables from setup), run in a forked child.
+  void GenerateFixtureCPP(std::ostream & cpp_file, const emp::String & status_filename,
+                          std::function<ConstexprResult(const emp::String &)> constexpr_probe) {
+    LoadCodeFile();
+
+    cpp_file
+      << "  auto _emperfect_test" << id << " = [&]() {\n"
+      << "  std::ofstream _emperfect_results(\"" << result_filename << "\");\n"
+      << "  _emperfect_timing_out = &_emperfect_results;\n"
+      << "  size_t _emperfect_error_count = 0;\n"
+      << "  [[maybe_unused]] size_t _emperfect_check_id = 0;\n\n"
+      << ProcessChecks(constexpr_probe) << "\n"
+      << "  _emperfect_report_times(_emperfect_results);\n"
+      << "  _emperfect_results << \"SCORE \" << (!_emperfect_error_count ? "
+          << points << " : 0) << \"\\n\";\n"
+      << "  };\n"
+      << "  _emperfect_fork(_emperfect_test" << id << ", \"" << input_filename << "\", \""
+          << output_filename << "\", \"" << error_filename << "\", " << timeout << ", \""
+          << status_filename << "\");\n\n";
+  }
+
 
   void PrintCode(OutputInfo & output) const {
     std::ostream & out = output.GetFile();
@@ -380,9 +621,26 @@ public:
     }
   }
 
+  // Load compiler output, truncating it (compilers can produce huge amounts for template errors).
+  emp::vector<emp::String> LoadCompileResults(bool & truncated) const {
+    constexpr size_t max_lines = 200;
+    constexpr size_t max_line_length = 500;
+    emp::vector<emp::String> lines;
+    truncated = false;
+    std::ifstream file(compile_filename);
+    std::string line;
+    while (std::getline(file, line)) {
+      if (lines.size() == max_lines) { truncated = true; break; }
+      if (line.size() > max_line_length) line = line.substr(0, max_line_length) + " ...";
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
   void PrintCompileResults(OutputInfo & output) const {
     std::ostream & out = output.GetFile();
-    emp::File file(compile_filename);
+    bool truncated = false;
+    emp::vector<emp::String> file = LoadCompileResults(truncated);
 
     // If there were no compilation issues, say so.
     if (file.size() == 0) {
@@ -403,10 +661,12 @@ public:
       for (auto line : file) {
         out << line.AsWebSafe() << "\n";
       }
+      if (truncated) out << "... (further compiler output not shown)\n";
       out << "</pre></tr></table>\n";
     } else {
       out << "Compile Results for Test:\n\n";
       for (auto line : file) out << line << "\n";
+      if (truncated) out << "... (further compiler output not shown)\n";
     }
   }
 
@@ -446,7 +706,7 @@ public:
       return;
     }
 
-    emp::File input_file(input_filename);
+    emp::File input_file = LoadFixture(input_filename);
 
     if (output.IsHTML()) {
       out << "<table>\n"
@@ -462,10 +722,24 @@ public:
     }
   }
 
+  // Show where each output (standard out or a compared file) first differed from what was expected.
+  void PrintOutputMismatches(OutputInfo & output) const {
+    if (output_mismatches.empty()) return;
+    std::ostream & out = output.GetFile();
+    if (output.IsHTML()) {
+      out << "<p>Output mismatches:<br>\n";
+      for (const auto & mismatch : output_mismatches) out << "&nbsp;&nbsp;" << mismatch.AsWebSafe() << "<br>\n";
+      out << "</p>\n";
+    } else {
+      out << "Output mismatches:\n";
+      for (const auto & mismatch : output_mismatches) out << "  " << mismatch << "\n";
+    }
+  }
+
   void PrintOutputDiff(OutputInfo & output) const {
     std::ostream & out = output.GetFile();
     emp::File output_file(output_filename);
-    emp::File expect_file(expect_filename);
+    emp::File expect_file = LoadFixture(expect_filename);
     std::stringstream out_ss, exp_ss;
     output_file.Write(out_ss);
     expect_file.Write(exp_ss);
@@ -506,6 +780,46 @@ public:
     }
   }
 
+  // Describe where a test was when it timed out (using the heartbeat from the executable).
+  emp::String GetTimeoutMessage() const {
+    auto check_string = [this](long long check_id) {
+      for (const auto & check : checks) {
+        if (static_cast<long long>(check.GetID()) == check_id) {
+          return emp::MakeString("CHECK #", check_id, ": ", check.GetTest().ToString());
+        }
+      }
+      return emp::MakeString("CHECK #", check_id);
+    };
+    const emp::String passed_string =
+      emp::MakeString(checks_passed, " of ", checks_finished, " checks run had passed");
+
+    if (timeout_check >= 0) {
+      return emp::MakeString("FAILED due to timeout during ", check_string(timeout_check),
+                             " (", passed_string, ").");
+    }
+    if (last_check >= 0) {
+      return emp::MakeString("FAILED due to timeout after ", check_string(last_check),
+                             " (", passed_string, ").");
+    }
+    return "FAILED due to timeout.";
+  }
+
+  // Report both runs of a test that was rerun for being close to its timeout.
+  void PrintResult_Rerun(OutputInfo & output) const {
+    if (!reran) return;
+    const emp::String status = GetStatusString();
+    emp::String message = emp::MakeString("This test was close to its ", timeout,
+      " second time limit, so it was run again once the grader was less busy. First run: ",
+      PerfMetric::FormatValue(first_run_time, PerfUnit::SECONDS), " (", first_status, "); second run: ",
+      PerfMetric::FormatValue(run_time, PerfUnit::SECONDS), " (", status, "). ");
+    if (status == first_status) message += "The result did not change.";
+    else message += emp::MakeString("The result changed from \"", first_status, "\" to \"", status, "\".");
+
+    std::ostream & out = output.GetFile();
+    if (output.IsHTML()) out << "<p>" << message.AsWebSafe() << "<br>\n";
+    else out << message << "\n";
+  }
+
   void PrintResult_Success(OutputInfo & output) const {
     std::ostream & out = output.GetFile();
 
@@ -519,8 +833,11 @@ public:
         color = "Red"; message = "FAILED due to unsuccessful check."; break;
       case TestStatus::FAILED_COMPILE:
         color = "DarkRed"; message = "FAILED during compilation."; break;
+      case TestStatus::FAILED_COMPILE_LIMIT:
+        color = "DarkRed";
+        message.Set("FAILED during compilation; compiler stopped at ", compile_limit, "."); break;
       case TestStatus::FAILED_TIME:
-        color = "Purple"; message = "FAILED due to timeout."; break;
+        color = "Purple"; message = GetTimeoutMessage(); break;
       case TestStatus::FAILED_RUN:
         color = "OrangeRed"; message = "FAILED due to run-time error."; break;
       case TestStatus::FAILED_OUTPUT:
@@ -529,6 +846,12 @@ public:
         color = "OrangeRed";
         message.Set("FAILED due to wrong error code (expected ", expect_exit_code,
                     "; received ", run_exit_code, ")."); break;
+      case TestStatus::FAILED_PERF:
+        color = "DarkOrange"; message = "FAILED due to missed performance targets."; break;
+      case TestStatus::FAILED_FIXTURE:
+        color = "DarkRed"; message.Set("FAILED because fixture setup ", fixture_error, "."); break;
+      case TestStatus::PENDING:
+        color = "Gray"; message = "PENDING; this test has not been run yet."; break;
     }
 
     if (output.IsHTML()) {
@@ -548,30 +871,97 @@ public:
     }
   }
 
+  // List the time spent in each check (for instructors, to find slow checks).
+  void PrintResult_Timing(OutputInfo & output) const {
+    if (!output.HasHiddenDetails() || !CountIf([](const auto & check){ return check.HasTiming(); })) return;
+
+    std::ostream & out = output.GetFile();
+    if (output.IsHTML()) {
+      out << "<p>Time per check:<br>\n<table>\n"
+          << "<tr><th>Check<th>Runs<th>Total<th>Min<th>Max</tr>\n";
+      for (const auto & check : checks) {
+        if (!check.HasTiming()) continue;
+        const CheckTiming & timing = check.GetTiming();
+        out << "<tr><td><code>" << check.GetTest().ToString().AsWebSafe() << "</code>"
+            << "<td align=\"right\">" << timing.count
+            << "<td align=\"right\">" << PerfMetric::FormatValue(timing.total, PerfUnit::SECONDS)
+            << "<td align=\"right\">" << PerfMetric::FormatValue(timing.min, PerfUnit::SECONDS)
+            << "<td align=\"right\">" << PerfMetric::FormatValue(timing.max, PerfUnit::SECONDS)
+            << "</tr>\n";
+      }
+      out << "</table><br>\n";
+    } else {
+      out << "========== TIME PER CHECK ==========\n"
+          << std::setw(8) << "Runs" << std::setw(12) << "Total" << std::setw(12) << "Min"
+          << std::setw(12) << "Max" << "  Check\n";
+      for (const auto & check : checks) {
+        if (!check.HasTiming()) continue;
+        const CheckTiming & timing = check.GetTiming();
+        out << std::setw(8) << timing.count
+            << std::setw(12) << PerfMetric::FormatValue(timing.total, PerfUnit::SECONDS)
+            << std::setw(12) << PerfMetric::FormatValue(timing.min, PerfUnit::SECONDS)
+            << std::setw(12) << PerfMetric::FormatValue(timing.max, PerfUnit::SECONDS)
+            << "  " << check.GetTest().ToString() << "\n";
+      }
+    }
+  }
+
+  void PrintResult_Metrics(OutputInfo & output) const {
+    if (metrics.size() == 0 && largest_symbols.size() == 0) return;
+
+    std::ostream & out = output.GetFile();
+    if (output.IsHTML()) out << "<p>Performance Measurements:<br>\n";
+    else out << "========== PERFORMANCE ==========\n";
+    for (const auto & [name, metric] : metrics) {
+      metric.PrintResults(output);
+    }
+
+    if (largest_symbols.size()) {
+      if (output.IsHTML()) {
+        out << "\nLargest functions in executable:\n<table>\n";
+        for (const auto & [symbol, size] : largest_symbols) {
+          out << "<tr><td align=\"right\"><code>" << PerfMetric::FormatValue(size, PerfUnit::BYTES)
+              << "</code><td><code>" << emp::String(symbol).AsWebSafe() << "</code></tr>\n";
+        }
+        out << "</table><br>\n";
+      } else {
+        out << "\nLargest functions in executable:\n";
+        for (const auto & [symbol, size] : largest_symbols) {
+          out << "  " << std::setw(10) << PerfMetric::FormatValue(size, PerfUnit::BYTES)
+              << "  " << symbol << "\n";
+        }
+      }
+    }
+    if (output.IsHTML()) out << "<br>\n";
+  }
+
   void PrintResult(OutputInfo & output) const {
     if (!output.HasResults()) return;
 
     PrintResult_Title(output);
     PrintResult_Success(output);
+    PrintResult_Rerun(output);
 
-    // Print extra information only if we are allowed to.
-    if ((hidden && !output.HasHiddenDetails())) return;
+    // Print extra information only if we are allowed to (and the test has been run).
+    if ((hidden && !output.HasHiddenDetails()) || pending) return;
 
     // Decide what else we print based on the status.
     const auto status = GetStatus();
     bool print_checks = status == TestStatus::FAILED_CHECK || output.HasPassedDetails();
     bool print_code = Failed() || output.HasPassedDetails() || true; // Always print!
-    bool print_compile = status == TestStatus::FAILED_COMPILE;
+    bool print_compile = status == TestStatus::FAILED_COMPILE || status == TestStatus::FAILED_COMPILE_LIMIT;
     bool print_error = status == TestStatus::FAILED_RUN;
     bool print_input = status == TestStatus::MISSED_ERROR || status == TestStatus::FAILED_OUTPUT || output.HasPassedDetails() || true; // Always print!
     bool print_diff = status == TestStatus::FAILED_RUN || status == TestStatus::FAILED_OUTPUT || true; // Always print! 
 
     if (print_checks) PrintResult_Checks(output);
+    PrintResult_Timing(output);
+    PrintResult_Metrics(output);
     if (print_code) PrintCode(output);
     if (print_compile) PrintCompileResults(output);
     if (print_error) PrintErrorResults(output);
     if (print_input) { PrintArgs(output); PrintInputFile(output); }
-    if (print_diff) PrintOutputDiff(output);
+    if (print_diff) { PrintOutputMismatches(output); PrintOutputDiff(output); }
   }
 
   void PrintDebug(std::ostream & out=std::cout) {
@@ -582,8 +972,19 @@ public:
         << "match_case........: " << (match_case ? "true" : "false") << "\n"
         << "match_space.......: " << (match_space ? "true" : "false") << "\n"
         << "call_main.........: " << (call_main ? "true" : "false") << "\n"
+        << "latency_mode......: " << (latency_mode ? "true" : "false") << "\n"
+        << "throughput_mode...: " << (throughput_mode ? "true" : "false") << "\n"
+        << "warmup............: " << warmup << "\n"
+        << "Repeats...........: " << repeat_warmup << " warmup, " << repeat_min << " to " << repeat_max
+                                  << " measured (CI target " << repeat_ci << ")\n"
+        << "pin_cpu...........: " << pin_cpu << "\n"
+        << "aslr..............: " << (aslr ? "true" : "false") << "\n"
+        << "build_stats.......: " << (build_stats ? "true" : "false") << "\n"
+        << "symbol_sizes......: " << symbol_sizes << "\n"
+        << "Reference command.: " << (reference_command.size() ? reference_command : "(none)") << "\n"
         << "Command Line Args.: " << args << "\n"
         << "FILENAME Input to provide...: " << (input_filename.size() ? input_filename : "(none)") << "\n"
+        << "Command to generate input...: " << (input_gen.size() ? input_gen : "(none)") << "\n"
         << "FILENAME Expected exit code.: " << expect_exit_code << "\n"
         << "FILENAME Expected output....: " << (expect_filename.size() ? expect_filename : "(none)") << "\n"
         << "FILENAME Code for testcase..: " << (code_filename.size() ? code_filename : "(none)") << "\n"
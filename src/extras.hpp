@@ -11,7 +11,13 @@
 #ifndef EMPERFECT_EXTRAS_HPP
 #define EMPERFECT_EXTRAS_HPP
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 /// Flip the provided comparator to the opposite (so "<" becomes ">=").
 std::string FlipComparator(std::string in) {
@@ -24,4 +30,69 @@ std::string FlipComparator(std::string in) {
   return "";
 }
 
+/// Find the value at a given percentile (0.0 to 100.0) using the nearest-rank method.
+double Percentile(std::vector<double> values, double percent) {
+  if (values.size() == 0) return 0.0;
+  std::sort(values.begin(), values.end());
+  size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * values.size()));
+  if (rank > 0) --rank;   // Convert rank into an index.
+  return values[std::min(rank, values.size() - 1)];
+}
+
+/// Find the geometric mean of a set of positive values (so each counts equally, whatever its scale).
+double GeometricMean(const std::vector<double> & values) {
+  if (values.size() == 0) return 0.0;
+  double log_total = 0.0;
+  for (double value : values) log_total += std::log(value);
+  return std::exp(log_total / values.size());
+}
+
+/// Hash a block of data with 64-bit FNV-1a; pass a previous hash in to continue from it.
+uint64_t HashFNV1a(std::string_view data, uint64_t hash=14695981039346656037ULL) {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/// One side of a DiffWindow: the text around the first difference, split up for highlighting.
+struct DiffExcerpt {
+  size_t skipped_before = 0;  ///< Characters left out before the excerpt.
+  std::string before;         ///< Matching text just before the difference.
+  std::string diff;           ///< Differing text (cut off after max_diff characters).
+  size_t skipped_diff = 0;    ///< Differing characters left out.
+  std::string after;          ///< Matching text just after the difference.
+  size_t skipped_after = 0;   ///< Characters left out after the excerpt.
+};
+
+/// Find where two strings first differ and take an excerpt of each around that spot, with up to
+/// `context` matching characters on either side and at most `max_diff` differing characters.
+/// Runs in linear time, and the excerpts stay small no matter how long the strings are.
+std::pair<DiffExcerpt, DiffExcerpt> DiffWindow(std::string_view lhs, std::string_view rhs,
+                                               size_t context=40, size_t max_diff=80) {
+  // Find the common prefix, then the common suffix of what remains.
+  const size_t min_size = std::min(lhs.size(), rhs.size());
+  size_t prefix = 0;
+  while (prefix < min_size && lhs[prefix] == rhs[prefix]) ++prefix;
+  size_t suffix = 0;
+  while (suffix < min_size - prefix && lhs[lhs.size()-suffix-1] == rhs[rhs.size()-suffix-1]) ++suffix;
+
+  auto make_excerpt = [=](std::string_view text) {
+    DiffExcerpt excerpt;
+    const size_t start = (prefix > context) ? prefix - context : 0;
+    const size_t diff_end = text.size() - suffix;
+    const size_t diff_shown = std::min(diff_end - prefix, max_diff);
+    const size_t after_end = std::min(text.size(), diff_end + context);
+    excerpt.skipped_before = start;
+    excerpt.before = text.substr(start, prefix - start);
+    excerpt.diff = text.substr(prefix, diff_shown);
+    excerpt.skipped_diff = diff_end - prefix - diff_shown;
+    excerpt.after = text.substr(diff_end, after_end - diff_end);
+    excerpt.skipped_after = text.size() - after_end;
+    return excerpt;
+  };
+  return { make_excerpt(lhs), make_excerpt(rhs) };
+}
+
 #endif